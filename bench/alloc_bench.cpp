@@ -0,0 +1,143 @@
+/*
+稳态请求的堆分配计数
+    替换malloc/calloc/realloc/free统计调用次数(operator new也经过malloc)，
+    通过io_uring模式的接口(recv_buf/recv_done/send_iov/send_done)在进程内驱动真实的http_conn，不经过socket和事件循环，
+    交给工作线程的请求(登录POST)在本线程调用process()，从完成队列取回结果
+    每种请求先在同一个keep-alive连接上处理几次，使读缓冲区、文件缓存、arena等进入稳态，再连续处理rounds次，
+    输出平均每个请求的分配次数，稳态下应当为0
+用法: alloc_bench [root] [rounds]，root默认为./resources，需要在仓库根目录下运行
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <map>
+#include <string>
+#include <vector>
+#include "../http/http_conn.h"
+
+extern "C" void *__libc_malloc(size_t size);
+extern "C" void *__libc_calloc(size_t n, size_t size);
+extern "C" void *__libc_realloc(void *ptr, size_t size);
+extern "C" void __libc_free(void *ptr);
+
+static long alloc_count;
+
+extern "C" void *malloc(size_t size)
+{
+    ++alloc_count;
+    return __libc_malloc(size);
+}
+
+extern "C" void *calloc(size_t n, size_t size)
+{
+    ++alloc_count;
+    return __libc_calloc(n, size);
+}
+
+extern "C" void *realloc(void *ptr, size_t size)
+{
+    ++alloc_count;
+    return __libc_realloc(ptr, size);
+}
+
+extern "C" void free(void *ptr) { __libc_free(ptr); }
+
+// http_conn.cpp中的用户表，预先放入一个用户供登录请求使用
+typedef std::map<std::string, std::string, std::less<> > user_map;
+extern user_map users;
+
+static const struct
+{
+    const char *name;
+    const char *request;
+} cases[] = {
+    {"GET /", "GET / HTTP/1.1\r\nHost: 127.0.0.1\r\nConnection: keep-alive\r\nAccept-Encoding: gzip\r\n\r\n"},
+    {"GET /frame.jpg", "GET /frame.jpg HTTP/1.1\r\nHost: 127.0.0.1\r\nConnection: keep-alive\r\n\r\n"},
+    {"Range", "GET /frame.jpg HTTP/1.1\r\nHost: 127.0.0.1\r\nConnection: keep-alive\r\n"
+              "Range: bytes=0-99,1000-1999\r\n\r\n"},
+    {"pipelined x2", "GET /0 HTTP/1.1\r\nHost: 127.0.0.1\r\nConnection: keep-alive\r\n\r\n"
+                     "GET /1 HTTP/1.1\r\nHost: 127.0.0.1\r\nConnection: keep-alive\r\n\r\n"},
+    {"POST login", "POST /2CGISQL.cgi HTTP/1.1\r\nHost: 127.0.0.1\r\nConnection: keep-alive\r\n"
+                   "Content-Type: application/x-www-form-urlencoded\r\nContent-Length: 25\r\n\r\n"
+                   "user=admin&password=admin"},
+    {"If-Modified-Since", "GET /frame.jpg HTTP/1.1\r\nHost: 127.0.0.1\r\nConnection: keep-alive\r\n"
+                          "If-Modified-Since: Fri, 01 Jan 2100 00:00:00 GMT\r\n\r\n"},
+};
+
+static const int CASE_NUM = sizeof(cases) / sizeof(cases[0]);
+
+static completion_queue completions;
+static std::vector<completion> done;
+
+// 把一个请求交给连接，并把生成的响应全部"发送"完，返回发送的字节数
+static long serve(http_conn &conn, const char *request)
+{
+    int len = strlen(request);
+    int room = 0;
+    char *buf = conn.recv_buf(room);
+    if (!buf || room < len)
+        return -1;
+    memcpy(buf, request, len);
+    http_conn::URING_NEXT next = conn.recv_done(len);
+    long sent = 0;
+    while (next == http_conn::URING_SEND || next == http_conn::URING_WORKER)
+    {
+        if (next == http_conn::URING_WORKER)
+        {
+            conn.process();
+            completions.drain(done);
+            next = (http_conn::URING_NEXT)done[0].next;
+            continue;
+        }
+        int count = 0;
+        struct iovec *iov = conn.send_iov(count);
+        int bytes = 0;
+        for (int i = 0; i < count; ++i)
+            bytes += iov[i].iov_len;
+        sent += bytes;
+        next = conn.send_done(bytes);
+    }
+    return next == http_conn::URING_RECV ? sent : -1;
+}
+
+int main(int argc, char *argv[])
+{
+    char cwd[200];
+    if (!getcwd(cwd, sizeof(cwd)))
+        return 1;
+    std::string root = argc > 1 ? argv[1] : std::string(cwd) + "/resources";
+    int rounds = argc > 2 ? atoi(argv[2]) : 10000;
+
+    users["admin"] = "admin";
+    file_cache::get_instance()->init(60 * 1000);
+    file_cache::get_instance()->preload(root.c_str());
+
+    // io_uring模式下连接没有epoll，所有I/O由调用者完成
+    http_conn *conn = new http_conn;
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    bool ok = true;
+    for (int i = 0; i < CASE_NUM; ++i)
+    {
+        conn->init(-1, addr, (char *)root.c_str(), 0, 1, -1, &completions);
+        long sent = 0;
+        for (int j = 0; j < 3 && sent >= 0; ++j)
+            sent = serve(*conn, cases[i].request);
+        if (sent < 0)
+        {
+            printf("%-17s failed\n", cases[i].name);
+            ok = false;
+            continue;
+        }
+
+        long before = alloc_count;
+        for (int j = 0; j < rounds; ++j)
+            serve(*conn, cases[i].request);
+        long allocs = alloc_count - before;
+        printf("%-17s response %6ld bytes  %.3f allocations/request\n", cases[i].name, sent,
+               (double)allocs / rounds);
+        ok = ok && allocs == 0;
+    }
+    return ok ? 0 : 1;
+}
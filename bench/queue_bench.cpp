@@ -0,0 +1,183 @@
+/*
+线程池任务队列的并发检查和吞吐量对比
+    producers个线程共提交tasks个任务(模拟事件循环投递)，workers个线程取任务，
+    每个取到的任务有一定概率由工作线程再次提交(模拟流水线请求)，
+    检查每个任务恰好被取走一次，输出每秒处理的任务数
+
+    list_queue为原来的实现：std::list + 一把互斥锁 + 一个信号量
+用法: queue_bench [workers] [producers] [tasks]
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+#include <list>
+#include <vector>
+#include <atomic>
+#include "../lock/locker.h"
+#include "../threadpool/work_steal_queue.h"
+#include "../threadpool/mpmc_queue.h"
+
+struct task
+{
+    int id;
+    int resubmit; // 还需要由工作线程再次提交的次数
+};
+
+static task stop_task; // 通知工作线程退出
+
+template <typename T>
+class list_queue
+{
+public:
+    list_queue(int worker_number, int max_requests) : m_max_requests(max_requests) { (void)worker_number; }
+
+    bool push(T *request)
+    {
+        m_lock.lock();
+        if ((int)m_list.size() >= m_max_requests)
+        {
+            m_lock.unlock();
+            return false;
+        }
+        m_list.push_back(request);
+        m_lock.unlock();
+        m_stat.post();
+        return true;
+    }
+
+    T *pop(int worker)
+    {
+        (void)worker;
+        m_stat.wait();
+        m_lock.lock();
+        T *request = m_list.front();
+        m_list.pop_front();
+        m_lock.unlock();
+        return request;
+    }
+
+private:
+    int m_max_requests;
+    std::list<T *> m_list;
+    locker m_lock;
+    sem m_stat;
+};
+
+template <typename Queue>
+struct bench
+{
+    Queue *queue;
+    std::vector<task> tasks;
+    std::atomic<int> *taken; // 每个任务被取走的次数
+    std::atomic<long> done;  // 已完成的任务数(含再次提交的)
+    std::atomic<int> next_producer;
+    std::atomic<int> next_worker;
+    int producers;
+
+    static void submit(Queue *q, task *t)
+    {
+        while (!q->push(t))
+            sched_yield(); // 队列满，等工作线程取走一些
+    }
+
+    static void *produce(void *arg)
+    {
+        bench *b = (bench *)arg;
+        int index = b->next_producer++;
+        for (size_t i = index; i < b->tasks.size(); i += b->producers)
+            submit(b->queue, &b->tasks[i]);
+        return NULL;
+    }
+
+    static void *work(void *arg)
+    {
+        bench *b = (bench *)arg;
+        int index = b->next_worker++;
+        while (true)
+        {
+            task *t = b->queue->pop(index);
+            if (t == &stop_task)
+                return NULL;
+            // 再次提交失败时直接完成，所有工作线程都等待队列空位会互相阻塞
+            if (t->resubmit > 0)
+            {
+                --t->resubmit;
+                if (b->queue->push(t))
+                    continue;
+            }
+            b->taken[t->id]++;
+            b->done++;
+        }
+    }
+};
+
+static double now_sec()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+template <typename Queue>
+static bool run(const char *name, int workers, int producers, int count)
+{
+    bench<Queue> b;
+    Queue queue(workers, 10000);
+    b.queue = &queue;
+    b.tasks.resize(count);
+    b.taken = new std::atomic<int>[count];
+    for (int i = 0; i < count; ++i)
+    {
+        b.tasks[i].id = i;
+        b.tasks[i].resubmit = i % 4 == 0 ? 1 : 0;
+        b.taken[i] = 0;
+    }
+    b.done = 0;
+    b.next_producer = 0;
+    b.next_worker = 0;
+    b.producers = producers;
+
+    double start = now_sec();
+    std::vector<pthread_t> threads(workers + producers);
+    for (int i = 0; i < workers; ++i)
+        pthread_create(&threads[i], NULL, bench<Queue>::work, &b);
+    for (int i = 0; i < producers; ++i)
+        pthread_create(&threads[workers + i], NULL, bench<Queue>::produce, &b);
+    for (int i = 0; i < producers; ++i)
+        pthread_join(threads[workers + i], NULL);
+    // 全部任务完成后队列中只剩退出通知，每个工作线程取到一个
+    while (b.done.load() < count)
+        sched_yield();
+    double elapsed = now_sec() - start;
+    for (int i = 0; i < workers; ++i)
+        bench<Queue>::submit(&queue, &stop_task);
+    for (int i = 0; i < workers; ++i)
+        pthread_join(threads[i], NULL);
+
+    bool ok = true;
+    for (int i = 0; i < count; ++i)
+        if (b.taken[i] != 1)
+        {
+            printf("%s: task %d taken %d times\n", name, i, b.taken[i].load());
+            ok = false;
+            break;
+        }
+    delete[] b.taken;
+    printf("%-16s workers %2d producers %d: %8.0f tasks/s %s\n", name, workers, producers, count / elapsed,
+           ok ? "OK" : "FAILED");
+    return ok;
+}
+
+int main(int argc, char *argv[])
+{
+    int workers = argc > 1 ? atoi(argv[1]) : 8;
+    int producers = argc > 2 ? atoi(argv[2]) : 1;
+    int count = argc > 3 ? atoi(argv[3]) : 1000000;
+
+    bool ok = run<list_queue<task> >("list_queue", workers, producers, count);
+    ok = run<work_steal_queue<task> >("work_steal_queue", workers, producers, count) && ok;
+    ok = run<mpmc_queue<task> >("mpmc_queue", workers, producers, count) && ok;
+    return ok ? 0 : 1;
+}
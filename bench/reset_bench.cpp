@@ -0,0 +1,159 @@
+/*
+连接复用时重置请求状态的对比
+    原来每个请求在reset时把m_real_file(200字节)清零，每个新连接在init时把写缓冲区清零；
+    现在只重置下标和状态，路径拼接和响应头生成自己写入结尾的'\0'
+    conn按http_conn中对应字段的大小和顺序排列，conns个连接轮流处理请求，每个连接连续处理keep_alive个请求后重新init，
+    每个请求在重置后写入一个文件路径和一个响应头，模拟请求实际触及的数据；连接数较多时缓冲区不在缓存中，
+    多余的清零会带来额外的缓存行写入
+用法: reset_bench [conns] [keep_alive] [requests]
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <vector>
+#include "../http/http_scan.h"
+
+static const int FILENAME_LEN = 200;
+static const int WRITE_BUFFER_SIZE = 4096;
+
+static const char doc_root[] = "/home/user/WebServer/resources";
+static const char url[] = "/picture.html";
+static const char header[] = "HTTP/1.1 200 OK\r\nContent-Length: 1234\r\nContent-Type: text/html; charset=utf-8\r\n"
+                             "Connection: keep-alive\r\nAccept-Ranges: bytes\r\n\r\n";
+
+struct conn
+{
+    int check_state;
+    bool linger;
+    bool upload;
+    long body_remain;
+    int method;
+    char *url;
+    char *version;
+    long content_length;
+    char *host;
+    int start_line;
+    long checked_idx;
+    int cgi;
+    int header_count;
+    signed char known[HEADER_COUNT];
+    int write_idx;
+    int iv_count;
+    char write_buf[WRITE_BUFFER_SIZE];
+    char real_file[FILENAME_LEN];
+};
+
+static void reset_request(conn *c)
+{
+    c->check_state = 0;
+    c->linger = false;
+    c->upload = false;
+    c->body_remain = 0;
+    c->method = 0;
+    c->url = 0;
+    c->version = 0;
+    c->content_length = 0;
+    c->host = 0;
+    c->start_line = 0;
+    c->checked_idx = 0;
+    c->cgi = 0;
+    c->header_count = 0;
+    memset(c->known, -1, sizeof(c->known));
+    c->write_idx = 0;
+    c->iv_count = 0;
+}
+
+// 原来的方式：每个请求清零路径，每个连接清零写缓冲区，拼接路径依赖已有的'\0'
+struct old_reset
+{
+    static void init(conn *c)
+    {
+        reset_request(c);
+        memset(c->write_buf, '\0', WRITE_BUFFER_SIZE);
+    }
+    static void next(conn *c)
+    {
+        reset_request(c);
+        memset(c->real_file, '\0', FILENAME_LEN);
+    }
+    static void use(conn *c)
+    {
+        int len = strlen(doc_root);
+        strcpy(c->real_file, doc_root);
+        // 原来的代码用strncpy(..., strlen(url))拼接，不写结尾的'\0'，依赖next()中的memset
+        memcpy(c->real_file + len, url, strlen(url));
+        memcpy(c->write_buf + c->write_idx, header, sizeof(header) - 1);
+        c->write_idx += sizeof(header) - 1;
+    }
+};
+
+// 现在的方式：只重置状态，路径和响应头各自写入结尾
+struct new_reset
+{
+    static void init(conn *c) { reset_request(c); }
+    static void next(conn *c) { reset_request(c); }
+    static void use(conn *c)
+    {
+        int len = strlen(doc_root);
+        memcpy(c->real_file, doc_root, len);
+        int n = strlen(url);
+        memcpy(c->real_file + len, url, n);
+        c->real_file[len + n] = '\0';
+        memcpy(c->write_buf + c->write_idx, header, sizeof(header) - 1);
+        c->write_idx += sizeof(header) - 1;
+        c->write_buf[c->write_idx] = '\0';
+    }
+};
+
+static double now_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+template <typename Reset>
+static double run(std::vector<conn> &conns, int keep_alive, long requests)
+{
+    int n = conns.size();
+    std::vector<int> served(n, 0);
+    for (int i = 0; i < n; ++i)
+        Reset::init(&conns[i]);
+
+    double start = now_ns();
+    for (long r = 0; r < requests; ++r)
+    {
+        conn *c = &conns[r % n];
+        int &count = served[r % n];
+        if (count == keep_alive)
+        {
+            // 连接关闭后fd被新连接复用
+            Reset::init(c);
+            count = 0;
+        }
+        else
+            Reset::next(c);
+        Reset::use(c);
+        ++count;
+    }
+    return (now_ns() - start) / requests;
+}
+
+int main(int argc, char *argv[])
+{
+    int n = argc > 1 ? atoi(argv[1]) : 10000;
+    int keep_alive = argc > 2 ? atoi(argv[2]) : 10;
+    long requests = argc > 3 ? atol(argv[3]) : 5000000;
+
+    std::vector<conn> conns(n);
+    // 先各运行一遍，使两者都从已经分配并写过的内存开始
+    run<old_reset>(conns, keep_alive, n);
+    run<new_reset>(conns, keep_alive, n);
+
+    double old_ns = run<old_reset>(conns, keep_alive, requests);
+    double new_ns = run<new_reset>(conns, keep_alive, requests);
+    printf("conns %d keep_alive %d (%zu bytes per conn): memset reset %6.1f ns/request  fast reset %6.1f ns/request\n",
+           n, keep_alive, sizeof(conn), old_ns, new_ns);
+    return 0;
+}
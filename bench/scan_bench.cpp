@@ -0,0 +1,200 @@
+/*
+请求报文扫描与原来逐字节解析的对比
+    用几个400~800字节的典型浏览器请求，分别按原来的方式(逐字节找\r\n，首部名逐个strncasecmp)
+    和现在的方式(http_scan向量化查找\r\n和':'，http_header_lookup完美哈希分派)切分请求行和各首部，
+    检查两者识别出的首部一致，输出每个请求的平均耗时
+用法: scan_bench [rounds]
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+#include "../http/http_scan.h"
+
+static const char *requests[] = {
+    "GET /judge.html HTTP/1.1\r\n"
+    "Host: 192.168.1.20:9006\r\n"
+    "Connection: keep-alive\r\n"
+    "Cache-Control: max-age=0\r\n"
+    "sec-ch-ua: \"Chromium\";v=\"124\", \"Google Chrome\";v=\"124\", \"Not-A.Brand\";v=\"99\"\r\n"
+    "sec-ch-ua-mobile: ?0\r\n"
+    "sec-ch-ua-platform: \"Windows\"\r\n"
+    "Upgrade-Insecure-Requests: 1\r\n"
+    "User-Agent: Mozilla/5.0 (Windows NT 10.0; Win64; x64) AppleWebKit/537.36 (KHTML, like Gecko) "
+    "Chrome/124.0.0.0 Safari/537.36\r\n"
+    "Accept: text/html,application/xhtml+xml,application/xml;q=0.9,image/avif,image/webp,image/apng,*/*;q=0.8,"
+    "application/signed-exchange;v=b3;q=0.7\r\n"
+    "Sec-Fetch-Site: none\r\n"
+    "Sec-Fetch-Mode: navigate\r\n"
+    "Sec-Fetch-User: ?1\r\n"
+    "Sec-Fetch-Dest: document\r\n"
+    "Accept-Encoding: gzip, deflate, br, zstd\r\n"
+    "Accept-Language: zh-CN,zh;q=0.9,en;q=0.8\r\n"
+    "\r\n",
+
+    "GET /frame.jpg HTTP/1.1\r\n"
+    "Host: 192.168.1.20:9006\r\n"
+    "Connection: keep-alive\r\n"
+    "User-Agent: Mozilla/5.0 (X11; Linux x86_64; rv:125.0) Gecko/20100101 Firefox/125.0\r\n"
+    "Accept: image/avif,image/webp,*/*\r\n"
+    "Accept-Language: en-US,en;q=0.5\r\n"
+    "Accept-Encoding: gzip, deflate, br\r\n"
+    "Referer: http://192.168.1.20:9006/picture.html\r\n"
+    "Cookie: session=6f1c2a9e4b7d8c3f0a5e2d1b9c8a7f6e; theme=dark; lang=zh-CN\r\n"
+    "If-Modified-Since: Mon, 06 May 2024 08:12:45 GMT\r\n"
+    "If-None-Match: \"17cf3a2b8e4d5c00-21042\"\r\n"
+    "Sec-Fetch-Dest: image\r\n"
+    "Sec-Fetch-Mode: no-cors\r\n"
+    "Sec-Fetch-Site: same-origin\r\n"
+    "\r\n",
+
+    "POST /2CGISQL.cgi HTTP/1.1\r\n"
+    "Host: 192.168.1.20:9006\r\n"
+    "Connection: keep-alive\r\n"
+    "Content-Length: 25\r\n"
+    "Cache-Control: max-age=0\r\n"
+    "Origin: http://192.168.1.20:9006\r\n"
+    "Content-Type: application/x-www-form-urlencoded\r\n"
+    "Upgrade-Insecure-Requests: 1\r\n"
+    "User-Agent: Mozilla/5.0 (Macintosh; Intel Mac OS X 10_15_7) AppleWebKit/605.1.15 (KHTML, like Gecko) "
+    "Version/17.4 Safari/605.1.15\r\n"
+    "Accept: text/html,application/xhtml+xml,application/xml;q=0.9,*/*;q=0.8\r\n"
+    "Referer: http://192.168.1.20:9006/1\r\n"
+    "Accept-Encoding: gzip, deflate\r\n"
+    "Accept-Language: zh-CN,zh-Hans;q=0.9\r\n"
+    "\r\n",
+};
+
+static const int REQUEST_NUM = sizeof(requests) / sizeof(requests[0]);
+
+// 原来的方式：与http_scan.cpp中的首部相同，逐个strncasecmp
+static const struct
+{
+    const char *name;
+    int len;
+    HTTP_HEADER id;
+} chain[] = {
+    {"Host:", 5, HEADER_HOST},
+    {"Connection:", 11, HEADER_CONNECTION},
+    {"Content-Length:", 15, HEADER_CONTENT_LENGTH},
+    {"Content-Type:", 13, HEADER_CONTENT_TYPE},
+    {"Accept:", 7, HEADER_ACCEPT},
+    {"Accept-Encoding:", 16, HEADER_ACCEPT_ENCODING},
+    {"Cookie:", 7, HEADER_COOKIE},
+    {"If-Modified-Since:", 18, HEADER_IF_MODIFIED_SINCE},
+    {"If-None-Match:", 14, HEADER_IF_NONE_MATCH},
+    {"If-Range:", 9, HEADER_IF_RANGE},
+    {"Range:", 6, HEADER_RANGE},
+    {"Referer:", 8, HEADER_REFERER},
+    {"User-Agent:", 11, HEADER_USER_AGENT},
+};
+
+// 返回识别出的首部的位图，两种方式结果应当相同
+static unsigned parse_bytewise(char *buf, int len)
+{
+    unsigned found = 0;
+    int idx = 0;
+    bool request_line = true;
+    while (idx < len)
+    {
+        // 原parse_line：逐字节找\r\n并改为\0
+        char *text = buf + idx;
+        for (; idx < len; ++idx)
+            if (buf[idx] == '\r' && idx + 1 < len && buf[idx + 1] == '\n')
+            {
+                buf[idx++] = '\0';
+                buf[idx++] = '\0';
+                break;
+            }
+        if (request_line)
+        {
+            request_line = false;
+            continue;
+        }
+        if (text[0] == '\0')
+            break;
+        // 原parse_headers：依次比较各首部名，再跳过值前的空白
+        for (size_t i = 0; i < sizeof(chain) / sizeof(chain[0]); ++i)
+            if (strncasecmp(text, chain[i].name, chain[i].len) == 0)
+            {
+                text += chain[i].len;
+                text += strspn(text, " \t");
+                found |= 1u << chain[i].id;
+                break;
+            }
+    }
+    return found;
+}
+
+static unsigned parse_scan(char *buf, int len)
+{
+    unsigned found = 0;
+    char *p = buf;
+    char *end = buf + len;
+    bool request_line = true;
+    while (p < end)
+    {
+        char *eol = (char *)http_scan(p, end, '\r', '\n');
+        if (eol + 1 >= end)
+            break;
+        eol[0] = '\0';
+        eol[1] = '\0';
+        char *text = p;
+        p = eol + 2;
+        if (request_line)
+        {
+            request_line = false;
+            continue;
+        }
+        if (text == eol)
+            break;
+        char *colon = (char *)http_scan(text, eol, ':', ':');
+        if (colon == eol)
+            continue;
+        HTTP_HEADER id = http_header_lookup(text, colon - text);
+        char *value = colon + 1;
+        value += strspn(value, " \t");
+        if (id != HEADER_UNKNOWN)
+            found |= 1u << id;
+    }
+    return found;
+}
+
+static double now_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+template <typename Parse>
+static double run(Parse parse, const char *src, int len, char *buf, int rounds, unsigned &found)
+{
+    double start = now_ns();
+    for (int i = 0; i < rounds; ++i)
+    {
+        memcpy(buf, src, len);
+        found = parse(buf, len);
+    }
+    return (now_ns() - start) / rounds;
+}
+
+int main(int argc, char *argv[])
+{
+    int rounds = argc > 1 ? atoi(argv[1]) : 1000000;
+    char buf[2048];
+    bool ok = true;
+    printf("scanner: %s\n", http_scan_impl());
+    for (int i = 0; i < REQUEST_NUM; ++i)
+    {
+        int len = strlen(requests[i]);
+        unsigned old_found = 0, new_found = 0;
+        double old_ns = run(parse_bytewise, requests[i], len, buf, rounds, old_found);
+        double new_ns = run(parse_scan, requests[i], len, buf, rounds, new_found);
+        printf("request %d (%3d bytes): bytewise %6.1f ns  scan %6.1f ns  %s\n", i, len, old_ns, new_ns,
+               old_found == new_found ? "OK" : "MISMATCH");
+        ok = ok && old_found == new_found;
+    }
+    return ok ? 0 : 1;
+}
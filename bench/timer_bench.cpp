@@ -0,0 +1,217 @@
+/*
+时间轮与原来的升序链表的对比
+    预先放入n个超时时间分布在一个空闲超时内的定时器，测量新连接的add和随机挑选定时器延长一个空闲超时的adjust，
+    最后把全部定时器改为已到期，测量一次tick处理全部到期定时器的时间(包括回调和释放定时器)
+    sort_timer_lst为原来的实现，add/adjust需要沿链表查找插入位置
+用法: timer_bench [n...]，默认10000和100000
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <vector>
+#include "../timer/lst_timer.h"
+#include "../http/http_conn.h"
+
+http_conn::shared_count http_conn::m_user_count(0); // lst_timer.cpp中的cb_func引用，这里不使用
+
+static const int TICK_MS = 5000;     // 与服务器的TIMESLOT一致
+static const int TIMEOUT_MS = 15000; // 与服务器的IDLE_TIMEOUT_MS一致
+
+static long expired_count;
+static void count_cb(client_data *) { ++expired_count; }
+
+class sort_timer_lst
+{
+public:
+    sort_timer_lst() : head(NULL), tail(NULL) {}
+    ~sort_timer_lst()
+    {
+        while (head)
+        {
+            util_timer *next = head->next;
+            delete head;
+            head = next;
+        }
+    }
+
+    void add_timer(util_timer *timer)
+    {
+        if (!head)
+        {
+            head = tail = timer;
+            return;
+        }
+        if (timer->expire < head->expire)
+        {
+            timer->next = head;
+            head->prev = timer;
+            head = timer;
+            return;
+        }
+        add_timer(timer, head);
+    }
+
+    void adjust_timer(util_timer *timer)
+    {
+        util_timer *tmp = timer->next;
+        if (!tmp || (timer->expire < tmp->expire))
+            return;
+        if (timer == head)
+        {
+            head = head->next;
+            head->prev = NULL;
+            timer->next = NULL;
+            add_timer(timer, head);
+        }
+        else
+        {
+            timer->prev->next = timer->next;
+            timer->next->prev = timer->prev;
+            add_timer(timer, timer->next);
+        }
+    }
+
+    void tick()
+    {
+        long long cur = time_ms();
+        while (head && cur >= head->expire)
+        {
+            util_timer *tmp = head;
+            tmp->cb_func(tmp->user_data);
+            head = tmp->next;
+            if (head)
+                head->prev = NULL;
+            delete tmp;
+        }
+        if (!head)
+            tail = NULL;
+    }
+
+private:
+    void add_timer(util_timer *timer, util_timer *lst_head)
+    {
+        util_timer *prev = lst_head;
+        util_timer *tmp = prev->next;
+        while (tmp)
+        {
+            if (timer->expire < tmp->expire)
+            {
+                prev->next = timer;
+                timer->next = tmp;
+                tmp->prev = timer;
+                timer->prev = prev;
+                return;
+            }
+            prev = tmp;
+            tmp = tmp->next;
+        }
+        prev->next = timer;
+        timer->prev = prev;
+        timer->next = NULL;
+        tail = timer;
+    }
+
+    util_timer *head;
+    util_timer *tail;
+};
+
+static double now_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+// 时间轮的初始化与服务器相同
+static void init_timers(time_wheel &wheel) { wheel.init(TICK_MS, TIMEOUT_MS); }
+static void init_timers(sort_timer_lst &) {}
+
+// 全部改为同一个已到期的时刻：链表仍然有序，不必移动；时间轮挂到下一个待扫描的槽位
+static void expire_all(sort_timer_lst &, std::vector<util_timer *> &all, long long expire)
+{
+    for (size_t i = 0; i < all.size(); ++i)
+        all[i]->expire = expire;
+}
+static void expire_all(time_wheel &wheel, std::vector<util_timer *> &all, long long expire)
+{
+    for (size_t i = 0; i < all.size(); ++i)
+    {
+        all[i]->expire = expire;
+        wheel.adjust_timer(all[i]);
+    }
+}
+
+template <typename Timers>
+static void run(const char *name, int n)
+{
+    Timers timers;
+    init_timers(timers);
+    std::vector<client_data> users(n);
+    std::vector<util_timer *> all(n);
+    srand(1);
+
+    // 预先放入n个定时器，按超时时间从大到小添加，链表每次都插在头部，准备过程不受O(n)插入影响
+    long long base = time_ms();
+    for (int i = n - 1; i >= 0; --i)
+    {
+        all[i] = new util_timer;
+        all[i]->user_data = &users[i];
+        all[i]->cb_func = count_cb;
+        all[i]->expire = base + (long long)i * TIMEOUT_MS / n;
+        timers.add_timer(all[i]);
+    }
+
+    // 原链表的add和adjust为O(n)，操作次数随n减少，避免运行过久
+    int ops = n >= 100000 ? 2000 : 20000;
+
+    // 新连接：超时时间为当前时刻加一个空闲超时，晚于已有的全部定时器
+    double start = now_ns();
+    for (int i = 0; i < ops; ++i)
+    {
+        util_timer *timer = new util_timer;
+        timer->user_data = &users[i % n];
+        timer->cb_func = count_cb;
+        timer->expire = base + TIMEOUT_MS + i;
+        timers.add_timer(timer);
+        all.push_back(timer);
+    }
+    double add_ns = (now_ns() - start) / ops;
+
+    // 读写事件：随机挑选一个定时器延长一个空闲超时
+    start = now_ns();
+    for (int i = 0; i < ops; ++i)
+    {
+        util_timer *timer = all[rand() % n];
+        timer->expire = base + TIMEOUT_MS + ops + i;
+        timers.adjust_timer(timer);
+    }
+    double adjust_ns = (now_ns() - start) / ops;
+
+    // 时间轮按槽位向上取整，取当前槽位起点之前的时刻，保证本次tick就会处理
+    expire_all(timers, all, base / TICK_MS * TICK_MS - 1);
+    expired_count = 0;
+    start = now_ns();
+    timers.tick();
+    double tick_ms = (now_ns() - start) / 1e6;
+
+    printf("%-14s n=%6d  add %7.1f ns  adjust %9.1f ns  tick(all expired) %7.2f ms  expired %ld\n", name, n, add_ns,
+           adjust_ns, tick_ms, expired_count);
+}
+
+int main(int argc, char *argv[])
+{
+    std::vector<int> sizes;
+    for (int i = 1; i < argc; ++i)
+        sizes.push_back(atoi(argv[i]));
+    if (sizes.empty())
+    {
+        sizes.push_back(10000);
+        sizes.push_back(100000);
+    }
+    for (size_t i = 0; i < sizes.size(); ++i)
+    {
+        run<sort_timer_lst>("sort_timer_lst", sizes[i]);
+        run<time_wheel>("time_wheel", sizes[i]);
+    }
+    return 0;
+}
@@ -0,0 +1,91 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stdlib.h>
+#include <string.h>
+
+/*
+按请求分配的临时内存(bump-pointer arena)
+    请求处理中的临时字符串等从连接自带的一块空间顺序分配，不逐个释放，请求处理完后reset()整体回收
+    自带空间不够时向系统申请更大的块接着分配，reset()时一并释放，稳态下处理请求不产生堆分配
+    分配出的内存只在当前请求内有效，不能被发送队列引用
+*/
+class arena
+{
+public:
+    static const size_t INLINE_SIZE = 512; // 连接自带的空间，覆盖绝大多数请求
+    static const size_t ALIGN = 8;
+
+    arena() : m_begin(m_inline), m_used(0), m_capacity(INLINE_SIZE), m_blocks(NULL) {}
+    ~arena() { reset(); }
+
+    // 分配size字节，按ALIGN对齐，失败返回NULL
+    void *alloc(size_t size)
+    {
+        size = (size + ALIGN - 1) & ~(ALIGN - 1);
+        if (size > m_capacity - m_used && !grow(size))
+            return NULL;
+        void *p = m_begin + m_used;
+        m_used += size;
+        return p;
+    }
+
+    // 复制s的前len个字节并以'\0'结尾
+    char *strndup(const char *s, size_t len)
+    {
+        char *p = (char *)alloc(len + 1);
+        if (p)
+        {
+            memcpy(p, s, len);
+            p[len] = '\0';
+        }
+        return p;
+    }
+
+    // 回收本次请求分配的全部内存
+    void reset()
+    {
+        while (m_blocks)
+        {
+            block *next = m_blocks->next;
+            free(m_blocks);
+            m_blocks = next;
+        }
+        m_begin = m_inline;
+        m_used = 0;
+        m_capacity = INLINE_SIZE;
+    }
+
+private:
+    struct block
+    {
+        block *next;
+        size_t pad; // 使块内数据按16字节对齐
+    };
+
+    // 当前空间剩下的部分不再使用，换一块至少翻倍的新块
+    bool grow(size_t size)
+    {
+        size_t capacity = m_capacity * 2;
+        if (capacity < size)
+            capacity = size;
+        block *b = (block *)malloc(sizeof(block) + capacity);
+        if (!b)
+            return false;
+        b->next = m_blocks;
+        m_blocks = b;
+        m_begin = (char *)(b + 1);
+        m_used = 0;
+        m_capacity = capacity;
+        return true;
+    }
+
+private:
+    alignas(ALIGN) char m_inline[INLINE_SIZE];
+    char *m_begin;     // 当前分配所在的空间
+    size_t m_used;
+    size_t m_capacity;
+    block *m_blocks;   // 自带空间之外申请的块，最新的在前
+};
+
+#endif
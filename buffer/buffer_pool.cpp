@@ -0,0 +1,74 @@
+#include "buffer_pool.h"
+
+#include <stdlib.h>
+
+buffer_pool::buffer_pool()
+{
+    m_max_size = MIN_BUFFER_SIZE;
+}
+
+buffer_pool::~buffer_pool()
+{
+    for (int i = 0; i < CLASS_NUM; ++i)
+        for (size_t j = 0; j < m_free[i].size(); ++j)
+            free(m_free[i][j]);
+}
+
+buffer_pool *buffer_pool::get_instance()
+{
+    static buffer_pool pool;
+    return &pool;
+}
+
+void buffer_pool::init(int max_size)
+{
+    int index = class_of(max_size);
+    if (index < 0)
+        index = CLASS_NUM - 1;
+    m_max_size = MIN_BUFFER_SIZE << index;
+}
+
+int buffer_pool::class_of(int size)
+{
+    int index = 0;
+    while (index < CLASS_NUM && (MIN_BUFFER_SIZE << index) < size)
+        ++index;
+    return index < CLASS_NUM ? index : -1;
+}
+
+char *buffer_pool::acquire(int size, int &capacity)
+{
+    if (size > m_max_size)
+        return NULL;
+    int index = class_of(size);
+    capacity = MIN_BUFFER_SIZE << index;
+
+    char *buf = NULL;
+    m_lock[index].lock();
+    if (!m_free[index].empty())
+    {
+        buf = m_free[index].back();
+        m_free[index].pop_back();
+    }
+    m_lock[index].unlock();
+
+    if (!buf)
+        buf = (char *)malloc(capacity);
+    return buf;
+}
+
+void buffer_pool::release(char *buf, int capacity)
+{
+    if (!buf)
+        return;
+    int index = class_of(capacity);
+    // 空闲缓冲区已经够多，直接还给系统
+    m_lock[index].lock();
+    if (m_free[index].size() < (size_t)(FREE_BYTES_MAX / capacity))
+    {
+        m_free[index].push_back(buf);
+        buf = NULL;
+    }
+    m_lock[index].unlock();
+    free(buf);
+}
@@ -0,0 +1,44 @@
+#ifndef BUFFER_POOL_H
+#define BUFFER_POOL_H
+
+#include <vector>
+#include "../lock/locker.h"
+
+using namespace std;
+
+/*
+按大小分级的缓冲区池
+    各级大小从MIN_BUFFER_SIZE开始依次翻倍，每级一个空闲链表，申请时取不小于所需大小的最小一级
+    连接只在需要时持有缓冲区，空闲后归还，65536个连接槽位不必各自带一块大数组
+    每级缓存的空闲缓冲区总量有上限，超出的直接释放
+*/
+class buffer_pool
+{
+public:
+    static buffer_pool *get_instance();
+
+    static const int MIN_BUFFER_SIZE = 2048;        // 最小一级的大小
+    static const int CLASS_NUM = 10;                // 级数，最大一级为MIN_BUFFER_SIZE << (CLASS_NUM - 1)
+    static const int FREE_BYTES_MAX = 8 * 1024 * 1024; // 每级最多缓存的空闲字节数
+
+    // max_size为单个缓冲区的上限，向上取整到某一级
+    void init(int max_size);
+    int max_size() { return m_max_size; }
+
+    // 取一块不小于size的缓冲区，实际大小通过capacity返回，size超过上限时返回NULL
+    char *acquire(int size, int &capacity);
+    void release(char *buf, int capacity);
+
+private:
+    buffer_pool();
+    ~buffer_pool();
+
+    static int class_of(int size); // 不小于size的最小一级，超过最大一级返回-1
+
+private:
+    int m_max_size;
+    locker m_lock[CLASS_NUM];         // 每级一把锁
+    vector<char *> m_free[CLASS_NUM]; // 每级的空闲缓冲区
+};
+
+#endif
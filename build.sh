@@ -1,3 +1,4 @@
 #!/bin/bash
 
-make server
\ No newline at end of file
+make server
+make precompress
@@ -0,0 +1,271 @@
+#include "file_cache.h"
+#include "../timer/lst_timer.h"
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <time.h>
+
+file_cache::file_cache()
+{
+    m_ttl_ms = 0;
+    m_max_entries = 0;
+}
+
+file_cache::~file_cache()
+{
+    for (entry_map::iterator it = m_entries.begin(); it != m_entries.end(); ++it)
+        release(it->second);
+}
+
+file_cache *file_cache::get_instance()
+{
+    static file_cache cache;
+    return &cache;
+}
+
+void file_cache::init(int ttl_ms, int max_entries)
+{
+    m_ttl_ms = ttl_ms;
+    m_max_entries = max_entries;
+}
+
+void file_cache::preload(const char *root)
+{
+    if (m_ttl_ms <= 0)
+        return;
+    DIR *dir = opendir(root);
+    if (!dir)
+        return;
+    struct dirent *ent;
+    while ((ent = readdir(dir)) != NULL)
+    {
+        if (ent->d_name[0] == '.')
+            continue;
+        // 与http_conn拼出的路径相同：根目录 + "/" + 文件名
+        string path = string(root) + "/" + ent->d_name;
+        file_entry *entry = NULL;
+        if (acquire(path.c_str(), entry) == FILE_OK)
+            release(entry);
+    }
+    closedir(dir);
+}
+
+file_cache::FILE_STATUS file_cache::acquire(const char *path, file_entry *&entry)
+{
+    entry = NULL;
+    long long now = time_ms();
+
+    // 命中且未过期，不产生任何系统调用
+    file_entry *cached = NULL;
+    if (m_ttl_ms > 0)
+    {
+        m_lock.lock();
+        entry_map::iterator it = m_entries.find(path);
+        if (it != m_entries.end())
+        {
+            cached = it->second;
+            if (now < cached->expire)
+            {
+                ++cached->refs;
+                m_lock.unlock();
+                entry = cached;
+                return FILE_OK;
+            }
+            ++cached->refs; // 锁外校验期间防止被其他线程替换后释放
+        }
+        m_lock.unlock();
+    }
+
+    struct stat st;
+    if (stat(path, &st) < 0)
+    {
+        if (cached)
+            release(cached);
+        return FILE_NOT_FOUND;
+    }
+
+    // 过期的缓存项校验：文件未被替换或修改时延长有效期，继续使用原来的映射
+    if (cached)
+    {
+        if (cached->st.st_ino == st.st_ino && cached->st.st_dev == st.st_dev &&
+            cached->st.st_size == st.st_size && cached->st.st_mtim.tv_sec == st.st_mtim.tv_sec &&
+            cached->st.st_mtim.tv_nsec == st.st_mtim.tv_nsec && cached->st.st_mode == st.st_mode)
+        {
+            cached->encodings = find_encodings(path, st);
+            m_lock.lock();
+            cached->expire = now + m_ttl_ms;
+            m_lock.unlock();
+            entry = cached;
+            return FILE_OK;
+        }
+        release(cached);
+    }
+
+    if (!(st.st_mode & S_IROTH))
+        return FILE_FORBIDDEN;
+
+    // 判断是否是目录
+    if (S_ISDIR(st.st_mode))
+        return FILE_IS_DIR;
+
+    FILE_STATUS ret = load(path, st, entry);
+    if (ret != FILE_OK || m_ttl_ms <= 0)
+        return ret;
+
+    // 放入缓存，缓存本身持有一个引用
+    entry->expire = now + m_ttl_ms;
+    m_lock.lock();
+    entry_map::iterator it = m_entries.find(path);
+    if (it == m_entries.end() && m_entries.size() >= m_max_entries)
+        evict_expired(now);
+    if (it != m_entries.end() || m_entries.size() < m_max_entries)
+    {
+        ++entry->refs;
+        file_entry *old = NULL;
+        if (it != m_entries.end())
+        {
+            // 原来的键指向旧项的path，旧项可能在release时析构，换成新项的path
+            old = it->second;
+            m_entries.erase(it);
+        }
+        m_entries[entry->path] = entry;
+        m_lock.unlock();
+        if (old)
+            release(old);
+        return FILE_OK;
+    }
+    m_lock.unlock();
+    return FILE_OK;
+}
+
+void file_cache::release(file_entry *entry)
+{
+    if (!entry)
+        return;
+    // 最后一个引用释放时解除映射
+    if (--entry->refs == 0)
+    {
+        if (entry->address)
+            munmap(entry->address, entry->st.st_size);
+        if (entry->fd >= 0)
+            close(entry->fd);
+        free(entry->response[0]);
+        free(entry->response[1]);
+        delete entry;
+    }
+}
+
+file_cache::FILE_STATUS file_cache::load(const char *path, const struct stat &st, file_entry *&entry)
+{
+    char *address = NULL;
+    int fd = -1;
+    if (st.st_size > 0)
+    {
+        // 以只读的方式打开文件，大文件通过sendfile发送，fd随缓存项一起保留
+        fd = open(path, O_RDONLY | O_CLOEXEC);
+        if (fd < 0)
+            return FILE_ERROR;
+        // 创建内存映射，小文件通过writev发送
+        address = (char *)mmap(0, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (address == MAP_FAILED)
+        {
+            close(fd);
+            return FILE_ERROR;
+        }
+    }
+
+    entry = new file_entry;
+    entry->path = path;
+    entry->st = st;
+    entry->address = address;
+    entry->fd = fd;
+    entry->encodings = find_encodings(path, st);
+    entry->mime = http_mime_type(path);
+    entry->expire = 0;
+    entry->refs = 1;
+    entry->response[0] = entry->response[1] = NULL;
+    entry->response_len[0] = entry->response_len[1] = 0;
+    build_validators(entry);
+    // 不缓存时文件只发送这一次，预先生成的响应用不上，只是多两次分配和复制
+    if (m_ttl_ms > 0 && st.st_size > 0 && st.st_size <= RESPONSE_CACHE_MAX)
+        build_response(entry);
+    return FILE_OK;
+}
+
+// ETag由修改时间(纳秒)和大小组成，文件被替换或修改后随之变化，不必读取文件内容计算哈希
+void file_cache::build_validators(file_entry *entry)
+{
+    struct tm tm;
+    char date[40];
+    gmtime_r(&entry->st.st_mtime, &tm);
+    strftime(date, sizeof(date), "%a, %d %b %Y %H:%M:%S GMT", &tm);
+    long long mtime_ns = (long long)entry->st.st_mtim.tv_sec * 1000000000 + entry->st.st_mtim.tv_nsec;
+    entry->etag_len = snprintf(entry->etag, sizeof(entry->etag), "\"%llx-%llx\"", mtime_ns, (long long)entry->st.st_size);
+    entry->validators_len = snprintf(entry->validators, sizeof(entry->validators), "Last-Modified: %s\r\nETag: %s\r\n",
+                                     date, entry->etag);
+}
+
+// 响应头与http_conn::process_write()为文件请求生成的一致
+// 状态行、随时间变化的Date以及随请求变化的Content-Encoding、Vary、Content-Type由连接每次写入，这里只生成之后不变的部分
+// Content-Type不放在这里，因为预压缩文件要用原文件的类型
+void file_cache::build_response(file_entry *entry)
+{
+    for (int linger = 0; linger < 2; ++linger)
+    {
+        char header[256];
+        int header_len = snprintf(header, sizeof(header), "%sAccept-Ranges: bytes\r\nContent-Length: %d\r\nConnection: %s\r\n\r\n",
+                                  entry->validators, (int)entry->st.st_size, linger ? "keep-alive" : "close");
+        char *buf = (char *)malloc(header_len + entry->st.st_size);
+        if (!buf)
+            return;
+        memcpy(buf, header, header_len);
+        memcpy(buf + header_len, entry->address, entry->st.st_size);
+        entry->response[linger] = buf;
+        entry->response_len[linger] = header_len + entry->st.st_size;
+    }
+}
+
+// path.gz、path.br存在且修改时间不早于原文件时才可用，原文件更新后未重新压缩的旧文件不会被发送
+int file_cache::find_encodings(const char *path, const struct stat &st)
+{
+    static const struct
+    {
+        const char *suffix;
+        int encoding;
+    } variants[] = {{".gz", ENCODING_GZIP}, {".br", ENCODING_BR}};
+
+    int encodings = 0;
+    for (size_t i = 0; i < sizeof(variants) / sizeof(variants[0]); ++i)
+    {
+        string encoded = string(path) + variants[i].suffix;
+        struct stat est;
+        if (stat(encoded.c_str(), &est) < 0 || !S_ISREG(est.st_mode) || !(est.st_mode & S_IROTH))
+            continue;
+        if (est.st_mtim.tv_sec > st.st_mtim.tv_sec ||
+            (est.st_mtim.tv_sec == st.st_mtim.tv_sec && est.st_mtim.tv_nsec >= st.st_mtim.tv_nsec))
+            encodings |= variants[i].encoding;
+    }
+    return encodings;
+}
+
+// 调用时已持有m_lock
+void file_cache::evict_expired(long long now)
+{
+    entry_map::iterator it = m_entries.begin();
+    while (it != m_entries.end())
+    {
+        if (now >= it->second->expire)
+        {
+            file_entry *expired = it->second;
+            it = m_entries.erase(it);
+            release(expired);
+        }
+        else
+            ++it;
+    }
+}
@@ -0,0 +1,93 @@
+#ifndef FILE_CACHE_H
+#define FILE_CACHE_H
+
+#include <sys/stat.h>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <atomic>
+#include "../lock/locker.h"
+#include "../http/http_mime.h"
+
+using namespace std;
+
+// 同名的预压缩文件，file_entry::encodings按位组合
+enum CONTENT_ENCODING
+{
+    ENCODING_GZIP = 1, // 存在path.gz
+    ENCODING_BR = 2    // 存在path.br
+};
+
+// 缓存的一个静态文件：整个文件的只读映射和stat结果
+struct file_entry
+{
+    string path;            // 完整的资源路径，也是m_entries中键所指向的内容
+    struct stat st;         // 文件属性
+    char *address;          // 文件映射地址，空文件为NULL
+    int fd;                 // 保持打开的文件描述符，供sendfile使用，空文件为-1
+    char validators[96];    // Last-Modified和ETag两个响应头，载入时生成
+    int validators_len;
+    char etag[48];          // ETag的值(含引号)，与If-None-Match比较
+    int etag_len;
+    const mime_type *mime;  // 按扩展名确定的Content-Type，载入时查一次
+    char *response[2];      // 小文件预先生成的响应(Content-Type之后的响应头+文件内容)，下标为是否keep-alive
+    int response_len[2];
+    std::atomic<int> encodings; // 不比本文件旧的预压缩文件，过期校验时重新检查
+    long long expire;       // 超过该时刻(单调时钟毫秒)后命中需要重新stat校验，由缓存的锁保护
+    std::atomic<int> refs;  // 引用计数，缓存本身持有一个，每个正在发送该文件的连接各持有一个
+};
+
+/*
+静态文件缓存
+    以完整路径为键，缓存文件的映射和stat结果，多个连接共享同一份映射，按引用计数释放
+    TTL内的命中不产生任何文件系统调用，TTL过期后的命中先stat，文件未变化时只延长有效期
+    文件被修改或删除后旧的映射仍由正在发送的连接持有，最后一个连接释放时才munmap
+*/
+class file_cache
+{
+public:
+    // 查找结果，与http_conn对资源的几种判断一一对应
+    enum FILE_STATUS
+    {
+        FILE_OK = 0,    // 获取成功
+        FILE_NOT_FOUND, // 文件不存在
+        FILE_FORBIDDEN, // 其他用户没有读权限
+        FILE_IS_DIR,    // 请求的是目录
+        FILE_ERROR      // 打开或映射失败
+    };
+
+    static file_cache *get_instance();
+
+    static const int RESPONSE_CACHE_MAX = 64 * 1024; // 不大于该大小的文件预先生成完整响应
+
+    // ttl_ms为0时不缓存，每次请求都重新打开并映射，max_entries为最多缓存的文件数
+    void init(int ttl_ms, int max_entries = 1024);
+
+    // 启动时把root目录下的文件全部载入缓存
+    void preload(const char *root);
+
+    // 获取path对应的文件，成功时entry的引用计数已加一，用完后必须release
+    FILE_STATUS acquire(const char *path, file_entry *&entry);
+    void release(file_entry *entry);
+
+private:
+    file_cache();
+    ~file_cache();
+
+    FILE_STATUS load(const char *path, const struct stat &st, file_entry *&entry); // 打开并映射文件
+    void build_validators(file_entry *entry);                                       // 生成ETag和Last-Modified
+    void build_response(file_entry *entry);                                         // 生成小文件的完整响应
+    static int find_encodings(const char *path, const struct stat &st);             // 查找同名的预压缩文件
+    void evict_expired(long long now);                                              // 缓存已满时淘汰过期的文件
+
+private:
+    int m_ttl_ms;
+    size_t m_max_entries;
+    locker m_lock; // 只保护m_entries，映射和stat在锁外完成
+    // 键指向值的path，请求时直接用char*构造string_view查找，不构造临时string
+    // 替换或淘汰缓存项时先从表中删除键，再释放值
+    typedef unordered_map<string_view, file_entry *> entry_map;
+    entry_map m_entries;
+};
+
+#endif
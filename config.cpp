@@ -30,11 +30,26 @@ Config::Config(){
 
     //并发模型,默认是proactor
     actor_model = 0;
+
+    //事件循环数量,默认每个CPU核一个
+    loop_num = 0;
+
+    //I/O后端,默认epoll
+    io_uring = 0;
+
+    //静态文件缓存有效期,默认2000毫秒
+    cache_ttl = 2000;
+
+    //读缓冲区上限,默认64KB
+    read_buf_max = 64;
+
+    //线程池任务队列,默认工作窃取队列
+    task_queue = 0;
 }
 
 void Config::parse_arg(int argc, char*argv[]){
     int opt;
-    const char *str = "p:l:m:o:s:t:c:a:"; //选项字符串
+    const char *str = "p:l:m:o:s:t:c:a:n:u:f:b:q:"; //选项字符串
 
     /*
     getopt()函数用于分析命令行参数
@@ -88,6 +103,31 @@ void Config::parse_arg(int argc, char*argv[]){
             actor_model = atoi(optarg);
             break;
         }
+        case 'n':
+        {
+            loop_num = atoi(optarg);
+            break;
+        }
+        case 'u':
+        {
+            io_uring = atoi(optarg);
+            break;
+        }
+        case 'f':
+        {
+            cache_ttl = atoi(optarg);
+            break;
+        }
+        case 'b':
+        {
+            read_buf_max = atoi(optarg);
+            break;
+        }
+        case 'q':
+        {
+            task_queue = atoi(optarg);
+            break;
+        }
         default:
             break;
         }
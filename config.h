@@ -42,12 +42,27 @@ public:
 
     //并发模型选择
     int actor_model;
+
+    //多反应堆模式下事件循环线程数量
+    int loop_num;
+
+    //是否使用io_uring
+    int io_uring;
+
+    //静态文件缓存的有效期(毫秒)
+    int cache_ttl;
+
+    //单个连接读缓冲区的上限(KB)
+    int read_buf_max;
+
+    //线程池任务队列
+    int task_queue;
 };
 
 #endif
 
 /*
-./server [-p port] [-l LOGWrite] [-m TRIGMode] [-o OPT_LINGER] [-s sql_num] [-t thread_num] [-c close_log] [-a actor_model]
+./server [-p port] [-l LOGWrite] [-m TRIGMode] [-o OPT_LINGER] [-s sql_num] [-t thread_num] [-c close_log] [-a actor_model] [-n loop_num] [-u io_uring] [-f cache_ttl] [-b read_buf_max] [-q task_queue]
 * -p，自定义端口号
   * 默认9006
 * -l，选择日志写入方式，默认同步写入
@@ -71,4 +86,18 @@ public:
 * -a，选择反应堆模型，默认Proactor
   * 0，Proactor模型
   * 1，Reactor模型
+  * 2，多反应堆模型，每个线程一个epoll循环，通过SO_REUSEPORT各自监听
+* -n，多反应堆模式下的事件循环数量
+  * 默认为0，即每个CPU核一个
+* -u，I/O后端，默认epoll
+  * 0，epoll + recv/writev
+  * 1，io_uring，请求在事件循环线程内处理，-a 2时每个循环一个io_uring实例
+* -f，静态文件缓存的有效期(毫秒)，过期后重新stat校验文件是否变化
+  * 默认为2000
+  * 0，不缓存，每次请求都重新打开并映射文件
+* -b，单个连接读缓冲区的上限(KB)，请求头或请求体超过该大小时关闭连接
+  * 默认为64，缓冲区从2KB开始按需翻倍
+* -q，线程池的任务队列，默认工作窃取队列
+  * 0，每个工作线程一个队列，空闲时互相窃取
+  * 1，所有工作线程共享一个无锁有界MPMC环形队列
 */
\ No newline at end of file
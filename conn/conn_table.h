@@ -0,0 +1,213 @@
+#ifndef CONN_TABLE_H
+#define CONN_TABLE_H
+
+#include <atomic>
+#include <vector>
+#include "../lock/locker.h"
+
+/*
+按fd索引的连接表
+    原来启动时一次性创建MAX_FD个连接对象，绝大部分从未用到却占着内存
+    现在按fd分段，每SLAB_SIZE个连接一个slab，某个fd第一次有连接时才分配它所在的slab
+    shrink()定期释放其中连接全部空闲的slab，常驻内存随在线连接数增减
+
+访问已分配的连接不加锁，只有分配和释放slab时加锁
+slab连续两次shrink()都空闲且期间没有新连接才从表中摘下
+工作线程通过任务队列持有连接指针：每个slab记录已交给线程池、尚未处理完的任务数(inflight)，不为0时不摘下也不释放，
+    排在积压队列中很久才运行的任务也不会访问已释放的slab
+摘下的slab不立即释放(quiescent-state回收)：每个事件循环在不持有连接引用的时刻(每轮等待事件之前)调用quiescent()，
+    记下当时的代数，所有事件循环都越过摘下时的代数后才释放，其他循环不会读到已释放的内存
+*/
+template <typename T>
+class conn_table
+{
+public:
+    static const int SLAB_SIZE = 64; // 每个slab的连接数
+
+    explicit conn_table(int max_fd);
+    ~conn_table();
+
+    // fd对应的连接，其所在的slab必须已经由acquire()分配
+    T &operator[](int fd)
+    {
+        return m_slabs[fd / SLAB_SIZE].load(std::memory_order_acquire)->items[fd % SLAB_SIZE];
+    }
+
+    // 新连接到来时调用，fd所在的slab不存在时分配
+    T &acquire(int fd);
+
+    // 摘下所有连接都满足idle的slab，返回摘下的slab数，内存在所有事件循环都越过之后释放
+    int shrink(bool (*idle)(const T &));
+
+    // fd所在slab的在途任务计数，分派任务时加一，工作线程处理完后减一，slab必须已经由acquire()分配
+    std::atomic<int> *inflight(int fd)
+    {
+        return &m_slabs[fd / SLAB_SIZE].load(std::memory_order_acquire)->inflight;
+    }
+
+    // fd所在的slab不存在时返回NULL，用于处理可能已经过期的fd
+    T *find(int fd)
+    {
+        slab *s = m_slabs[fd / SLAB_SIZE].load(std::memory_order_acquire);
+        return s ? &s->items[fd % SLAB_SIZE] : NULL;
+    }
+
+    // 访问连接表的事件循环数，在事件循环启动前调用一次
+    void init_readers(int reader_num);
+
+    // 第reader个事件循环此刻不持有任何连接的引用
+    void quiescent(int reader)
+    {
+        m_readers[reader].epoch.store(m_epoch.load(std::memory_order_acquire), std::memory_order_release);
+    }
+
+    // 第reader个事件循环不再访问连接表(已退出或未能启动)
+    void offline(int reader)
+    {
+        m_readers[reader].epoch.store(~0UL, std::memory_order_release);
+    }
+
+    // 当前已分配的slab数
+    int slab_count() { return m_slab_count; }
+
+private:
+    struct slab
+    {
+        T items[SLAB_SIZE];
+        bool was_idle; // 上一次shrink()时是否空闲，之后有新连接时清除
+        std::atomic<int> inflight; // 在途任务数
+    };
+
+    // 每个事件循环最近一次quiescent()时看到的代数，各占一个缓存行
+    struct alignas(64) reader
+    {
+        std::atomic<unsigned long> epoch;
+    };
+
+    // 已从表中摘下、等待所有事件循环越过retire_epoch后释放的slab
+    struct retired_slab
+    {
+        slab *s;
+        unsigned long retire_epoch;
+    };
+
+    void reclaim(); // 释放所有事件循环都已越过的slab，调用时持有m_lock
+
+    std::atomic<slab *> *m_slabs;
+    int m_slab_num;
+    int m_slab_count;
+    locker m_lock; // 保护slab的分配和释放
+    std::atomic<unsigned long> m_epoch; // 每摘下一批slab加一
+    reader *m_readers;
+    int m_reader_num;
+    std::vector<retired_slab> m_retired;
+};
+
+template <typename T>
+conn_table<T>::conn_table(int max_fd)
+{
+    m_slab_num = (max_fd + SLAB_SIZE - 1) / SLAB_SIZE;
+    m_slab_count = 0;
+    m_epoch = 0;
+    m_readers = NULL;
+    m_reader_num = 0;
+    m_slabs = new std::atomic<slab *>[m_slab_num];
+    for (int i = 0; i < m_slab_num; ++i)
+        m_slabs[i].store(NULL, std::memory_order_relaxed);
+}
+
+template <typename T>
+conn_table<T>::~conn_table()
+{
+    for (int i = 0; i < m_slab_num; ++i)
+        delete m_slabs[i].load(std::memory_order_relaxed);
+    delete[] m_slabs;
+    for (size_t i = 0; i < m_retired.size(); ++i)
+        delete m_retired[i].s;
+    delete[] m_readers;
+}
+
+template <typename T>
+void conn_table<T>::init_readers(int reader_num)
+{
+    m_readers = new reader[reader_num];
+    for (int i = 0; i < reader_num; ++i)
+        m_readers[i].epoch.store(0, std::memory_order_relaxed);
+    m_reader_num = reader_num;
+}
+
+template <typename T>
+T &conn_table<T>::acquire(int fd)
+{
+    m_lock.lock();
+    slab *s = m_slabs[fd / SLAB_SIZE].load(std::memory_order_relaxed);
+    if (!s)
+    {
+        s = new slab;
+        s->inflight.store(0, std::memory_order_relaxed);
+        m_slabs[fd / SLAB_SIZE].store(s, std::memory_order_release);
+        ++m_slab_count;
+    }
+    s->was_idle = false;
+    m_lock.unlock();
+    return s->items[fd % SLAB_SIZE];
+}
+
+template <typename T>
+int conn_table<T>::shrink(bool (*idle)(const T &))
+{
+    int freed = 0;
+    unsigned long retire_epoch = m_epoch.load(std::memory_order_relaxed) + 1;
+    m_lock.lock();
+    for (int i = 0; i < m_slab_num; ++i)
+    {
+        slab *s = m_slabs[i].load(std::memory_order_relaxed);
+        if (!s)
+            continue;
+        // 仍有任务在线程池中排队或运行时不算空闲
+        bool all_idle = s->inflight.load(std::memory_order_acquire) == 0;
+        for (int j = 0; j < SLAB_SIZE && all_idle; ++j)
+            all_idle = idle(s->items[j]);
+        if (all_idle && s->was_idle)
+        {
+            // 先从表中摘下，其他事件循环此后读不到它，但可能仍在使用之前读到的指针
+            m_slabs[i].store(NULL, std::memory_order_relaxed);
+            retired_slab r = {s, retire_epoch};
+            m_retired.push_back(r);
+            --m_slab_count;
+            ++freed;
+        }
+        else
+            s->was_idle = all_idle;
+    }
+    // 摘下之后再推进代数，之后读到新代数的事件循环一定也能看到摘下的结果
+    if (freed > 0)
+        m_epoch.store(retire_epoch, std::memory_order_seq_cst);
+    reclaim();
+    m_lock.unlock();
+    return freed;
+}
+
+template <typename T>
+void conn_table<T>::reclaim()
+{
+    unsigned long oldest = ~0UL;
+    for (int i = 0; i < m_reader_num; ++i)
+    {
+        unsigned long epoch = m_readers[i].epoch.load(std::memory_order_acquire);
+        if (epoch < oldest)
+            oldest = epoch;
+    }
+    size_t kept = 0;
+    for (size_t i = 0; i < m_retired.size(); ++i)
+    {
+        // 摘下后不会再有新任务，摘下前已分派的任务要等它们处理完
+        if (m_retired[i].retire_epoch <= oldest && m_retired[i].s->inflight.load(std::memory_order_acquire) == 0)
+            delete m_retired[i].s;
+        else
+            m_retired[kept++] = m_retired[i];
+    }
+    m_retired.resize(kept);
+}
+
+#endif
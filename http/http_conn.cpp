@@ -1,25 +1,46 @@
 #include "http_conn.h"
 
 #include <mysql/mysql.h>
+#include <ctype.h>
 #include <fstream>
 
-// 定义http响应的一些状态信息
-const char *ok_200_title = "OK";
-const char *error_400_title = "Bad Request";
-const char *error_400_form = "Your request has bad syntax or is inherently impossible to staisfy.\n";
-const char *error_403_title = "Forbidden";
-const char *error_403_form = "You do not have permission to get file form this server.\n";
-const char *error_404_title = "Not Found";
-const char *error_404_form = "The requested file was not found on this server.\n";
-const char *error_500_title = "Internal Error";
-const char *error_500_form = "There was an unusual problem serving the request file.\n";
+// 定义http响应的一些状态信息，状态行在编译期拼好，发送时整段复制
+const char ok_200_status[] = "HTTP/1.1 200 OK\r\n";
+const char ok_201_status[] = "HTTP/1.1 201 Created\r\n";
+const char partial_206_status[] = "HTTP/1.1 206 Partial Content\r\n";
+const char not_modified_304_status[] = "HTTP/1.1 304 Not Modified\r\n";
+const char ok_201_form[] = "The file was uploaded.\n";
+const char error_400_status[] = "HTTP/1.1 400 Bad Request\r\n";
+const char error_400_form[] = "Your request has bad syntax or is inherently impossible to staisfy.\n";
+const char error_403_status[] = "HTTP/1.1 403 Forbidden\r\n";
+const char error_403_form[] = "You do not have permission to get file form this server.\n";
+const char error_404_status[] = "HTTP/1.1 404 Not Found\r\n";
+const char error_404_form[] = "The requested file was not found on this server.\n";
+const char error_411_status[] = "HTTP/1.1 411 Length Required\r\n";
+const char error_411_form[] = "An upload must carry a Content-Length header.\n";
+const char error_416_status[] = "HTTP/1.1 416 Range Not Satisfiable\r\n";
+const char error_500_status[] = "HTTP/1.1 500 Internal Error\r\n";
+const char error_500_form[] = "There was an unusual problem serving the request file.\n";
+const char empty_file_form[] = "<html><body></body></html>";
+
+// 字符串常量及其长度，长度在编译期确定
+#define LITERAL(s) s, (int)sizeof(s) - 1
+
+// 多范围响应(multipart/byteranges)各段之间的分隔符
+#define RANGE_BOUNDARY "3d6b6a416f9b5c2e"
+const char range_part_begin[] = "\r\n--" RANGE_BOUNDARY "\r\n";
+const char range_part_end[] = "\r\n--" RANGE_BOUNDARY "--\r\n";
+const char content_range_prefix[] = "Content-Range: bytes ";
 
 locker m_lock;             // 锁
-map<string, string> users; // 用户名和密码的map表
+typedef map<string, string, less<>> user_map;
+user_map users; // 用户名和密码的map表
 
 // 同步线程初始化数据库读取表
-void http_conn::initmysql_result(connection_pool *connPool)
+void http_conn::initmysql_result(connection_pool *connPool, int close_log)
 {
+    int m_close_log = close_log; // 静态函数中供LOG_ERROR使用
+
     // 先从连接池中取一个连接
     MYSQL *mysql = NULL;
     connectionRAII mysqlcon(&mysql, connPool);
@@ -111,8 +132,16 @@ void modfd(int epollfd, int fd, int ev, int TRIGMode)
     epoll_ctl(epollfd, EPOLL_CTL_MOD, fd, &event);
 }
 
-int http_conn::m_user_count = 0; // 用户总量，静态成员
-int http_conn::m_epollfd = -1;
+http_conn::shared_count http_conn::m_user_count(0); // 用户总量，静态成员
+std::atomic<unsigned> http_conn::m_next_generation(0);
+
+// 连接表释放空闲slab时析构，归还仍持有的缓存文件、读缓冲区和上传文件
+http_conn::~http_conn()
+{
+    unmap();
+    abort_upload();
+    release_read_buf();
+}
 
 // 关闭连接，关闭一个连接，客户总量减一
 void http_conn::close_conn(bool real_close)
@@ -126,36 +155,68 @@ void http_conn::close_conn(bool real_close)
     }
 }
 
+// 由工作线程调用，读写失败时交给事件循环关闭连接并删除定时器
+void http_conn::notify_close()
+{
+    m_completions->post(m_sockfd, m_generation);
+}
+
 // 初始化连接,外部调用初始化套接字地址
 void http_conn::init(int sockfd, const sockaddr_in &addr, char *root, int TRIGMode,
-                     int close_log, string user, string passwd, string sqlname)
+                     int close_log, int epollfd, completion_queue *completions)
 {
+    // 布局检查：事件循环写的一组字段正好占对象开头的一个缓存行，工作线程每个请求读写的热数据从下一行开始，
+    // 到发送队列之前不超过四行；用户计数独占一个缓存行
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Winvalid-offsetof"
+    static_assert(offsetof(http_conn, m_state) == 0 && offsetof(http_conn, m_read_buf) == 64,
+                  "loop-written fields must fill exactly the first cache line");
+    static_assert(offsetof(http_conn, m_iv) <= 5 * 64, "per-request hot fields must fit in four cache lines");
+    static_assert(sizeof(shared_count) == 64, "m_user_count must own its cache line");
+#pragma GCC diagnostic pop
+
+    // 上一个使用该fd的连接可能在发送文件途中被关闭
+    unmap();
+
     m_sockfd = sockfd;
+    m_generation = m_next_generation.fetch_add(1, std::memory_order_relaxed) + 1;
     m_address = addr;
+    m_epollfd = epollfd;
+    m_completions = completions;
+    m_TRIGMode = TRIGMode;
 
-    addfd(m_epollfd, sockfd, true, m_TRIGMode);
+    // io_uring模式下没有epoll，由事件循环直接提交I/O
+    if (m_epollfd >= 0)
+        addfd(m_epollfd, sockfd, true, m_TRIGMode);
     m_user_count++; // 用户端数量+1
 
     // 当浏览器出现连接重置时，可能是网站根目录出错或http响应格式出错或者访问的文件中内容完全为空
     doc_root = root;
-    m_TRIGMode = TRIGMode;
     m_close_log = close_log;
 
-    strcpy(sql_user, user.c_str());
-    strcpy(sql_passwd, passwd.c_str());
-    strcpy(sql_name, sqlname.c_str());
-
     init();
 }
 
 // 初始化新接受的连接
 void http_conn::init()
 {
-    mysql = NULL;
-    bytes_to_send = 0;
-    bytes_have_send = 0;
+    abort_upload();
+    m_read_idx = 0;
+    m_state = 0;
+    m_keep_alive = false;
+    m_pipelined = false;
+    reset_request();
+    reset_response();
+    release_read_buf();
+}
+
+// 重置请求解析状态，读缓冲区中的数据保持不变
+void http_conn::reset_request()
+{
     m_check_state = CHECK_STATE_REQUESTLINE; // check_state默认为分析请求行状态
     m_linger = false;
+    m_upload = false;
+    m_body_remain = 0;
     m_method = GET;
     m_url = 0;
     m_version = 0;
@@ -163,55 +224,121 @@ void http_conn::init()
     m_host = 0;
     m_start_line = 0;
     m_checked_idx = 0;
-    m_read_idx = 0;
-    m_write_idx = 0;
     cgi = 0;
-    m_state = 0;
-    timer_flag = 0;
-    improv = 0;
+    m_string = NULL;
+    m_arena.reset();
+    m_route = NULL;
+    m_encoding = 0;
+    m_vary = false;
+    m_header_count = 0;
+    memset(m_known, -1, sizeof(m_known));
+}
 
-    memset(m_read_buf, '\0', READ_BUFFER_SIZE);
-    memset(m_write_buf, '\0', WRITE_BUFFER_SIZE);
-    memset(m_real_file, '\0', FILENAME_LEN);
+// 清空发送队列
+void http_conn::reset_response()
+{
+    bytes_to_send = 0;
+    bytes_have_send = 0;
+    m_write_idx = 0;
+    m_iv_count = 0;
+    m_iv_idx = 0;
+    m_sendfile_fd = -1;
+    m_sendfile_offset = 0;
+}
+
+// 保证读缓冲区还有空闲空间：第一次读时从缓冲区池取一块初始大小的，满了之后换一块大一级的
+// 已解析出的m_url等指针随数据一起平移，首部表记录的是偏移量不受影响；已到上限时返回false
+bool http_conn::reserve_read()
+{
+    if (m_read_buf && m_read_idx < m_read_size)
+        return true;
+
+    buffer_pool *pool = buffer_pool::get_instance();
+    int capacity = 0;
+    char *buf = pool->acquire(m_read_buf ? (m_read_size + 1) * 2 : READ_BUFFER_SIZE, capacity);
+    if (!buf)
+        return false;
+    if (m_read_buf)
+    {
+        memcpy(buf, m_read_buf, m_read_idx);
+        if (m_url)
+            m_url = buf + (m_url - m_read_buf);
+        if (m_version)
+            m_version = buf + (m_version - m_read_buf);
+        if (m_host)
+            m_host = buf + (m_host - m_read_buf);
+        pool->release(m_read_buf, m_read_size + 1);
+    }
+    m_read_buf = buf;
+    m_read_size = capacity - 1;
+    return true;
+}
+
+void http_conn::release_read_buf()
+{
+    if (m_read_buf)
+    {
+        buffer_pool::get_instance()->release(m_read_buf, m_read_size + 1);
+        m_read_buf = NULL;
+        m_read_size = 0;
+    }
+}
+
+// 当前请求已生成响应，把它之后的数据(流水线中的下一个请求)移到读缓冲区头部，重新开始解析
+void http_conn::next_request()
+{
+    long end = m_checked_idx;
+    // 上传请求的请求体已在parse_upload()中移出读缓冲区
+    if (m_check_state == CHECK_STATE_CONTENT && !m_upload)
+    {
+        end += m_content_length;
+        // 请求体末尾的'\0'覆盖了下一个请求的第一个字节
+        if (end < m_read_idx)
+            m_read_buf[end] = m_body_end;
+    }
+    if (end > m_read_idx)
+        end = m_read_idx;
+    assert(end >= m_checked_idx);
+    memmove(m_read_buf, m_read_buf + end, m_read_idx - end);
+    m_read_idx -= end;
+    reset_request();
 }
 
 // 从状态机，用于分析出一行内容
 // 返回值为行的读取状态，有LINE_OK,LINE_BAD,LINE_OPEN
 http_conn::LINE_STATUS http_conn::parse_line()
 {
-    char temp;
-    for (; m_checked_idx < m_read_idx; ++m_checked_idx) // 遍历一行数据
+    // 向量化查找下一个\r或\n，中间的普通字符整段跳过
+    const char *end = m_read_buf + m_read_idx;
+    const char *pos = http_scan(m_read_buf + m_checked_idx, end, '\r', '\n');
+    m_checked_idx = pos - m_read_buf;
+    if (pos == end) // 没有行结束符，不完整
+        return LINE_OPEN;
+
+    // 正常情况应该以/r/n结尾
+    // 如果当前为/r，则判断下一个是不是/n
+    if (*pos == '\r')
     {
-        temp = m_read_buf[m_checked_idx];
-        // 正常情况应该以/r/n结尾
-        // 如果当前为/r，则判断下一个是不是/n
-        if (temp == '\r')
+        if ((m_checked_idx + 1) == m_read_idx) // 不完整
+            return LINE_OPEN;
+        else if (m_read_buf[m_checked_idx + 1] == '\n') // 完整
         {
-            if ((m_checked_idx + 1) == m_read_idx) // 不完整
-                return LINE_OPEN;
-            else if (m_read_buf[m_checked_idx + 1] == '\n') // 完整
-            {
-                // 将/r/n替换为\0\0
-                m_read_buf[m_checked_idx++] = '\0';
-                m_read_buf[m_checked_idx++] = '\0';
-                return LINE_OK;
-            }
-            return LINE_BAD;
-        }
-        // 如果当前为/n，则判断上一个是不是/r
-        else if (temp == '\n')
-        {
-            if (m_checked_idx > 1 && m_read_buf[m_checked_idx - 1] == '\r')
-            {
-                // 将/r/n替换为\0\0
-                m_read_buf[m_checked_idx - 1] = '\0';
-                m_read_buf[m_checked_idx++] = '\0';
-                return LINE_OK;
-            }
-            return LINE_BAD;
+            // 将/r/n替换为\0\0
+            m_read_buf[m_checked_idx++] = '\0';
+            m_read_buf[m_checked_idx++] = '\0';
+            return LINE_OK;
         }
+        return LINE_BAD;
     }
-    return LINE_OPEN;
+    // 如果当前为/n，则判断上一个是不是/r
+    if (m_checked_idx > 1 && m_read_buf[m_checked_idx - 1] == '\r')
+    {
+        // 将/r/n替换为\0\0
+        m_read_buf[m_checked_idx - 1] = '\0';
+        m_read_buf[m_checked_idx++] = '\0';
+        return LINE_OK;
+    }
+    return LINE_BAD;
 }
 
 // 读数据
@@ -219,7 +346,13 @@ http_conn::LINE_STATUS http_conn::parse_line()
 //  非阻塞ET工作模式下，需要一次性将数据读完
 bool http_conn::read_once()
 {
-    if (m_read_idx >= READ_BUFFER_SIZE)
+    // 上传请求缓冲区中的请求体都已写入文件，剩下的直接从socket splice到文件
+    if (m_body_fd >= 0 && m_body_remain > 0 && m_read_idx == m_checked_idx)
+    {
+        return splice_body();
+    }
+    // 缓冲区已到上限仍装不下一个完整的请求
+    if (!reserve_read())
     {
         return false;
     }
@@ -228,7 +361,7 @@ bool http_conn::read_once()
     // LT读取数据
     if (0 == m_TRIGMode)
     {
-        bytes_read = recv(m_sockfd, m_read_buf + m_read_idx, READ_BUFFER_SIZE - m_read_idx, 0);
+        bytes_read = recv(m_sockfd, m_read_buf + m_read_idx, m_read_size - m_read_idx, 0);
         m_read_idx += bytes_read;
 
         if (bytes_read <= 0)
@@ -244,7 +377,7 @@ bool http_conn::read_once()
     {
         while (true)
         {
-            bytes_read = recv(m_sockfd, m_read_buf + m_read_idx, READ_BUFFER_SIZE - m_read_idx, 0);
+            bytes_read = recv(m_sockfd, m_read_buf + m_read_idx, m_read_size - m_read_idx, 0);
             if (bytes_read == -1)
             {
                 if (errno == EAGAIN || errno == EWOULDBLOCK) // 没有数据了
@@ -256,6 +389,8 @@ bool http_conn::read_once()
                 return false;
             }
             m_read_idx += bytes_read; // 已经读到数据，将m_read_idx标识符后移
+            if (!reserve_read()) // 缓冲区已到上限，剩余数据等处理完已有的流水线请求后再读
+                break;
             // std::cout << "ET:\n" << m_read_buf << std::endl;
         }
         return true;
@@ -285,6 +420,8 @@ http_conn::HTTP_CODE http_conn::parse_request_line(char *text)
         m_method = POST;
         cgi = 1;
     }
+    else if (strcasecmp(method, "PUT") == 0)
+        m_method = PUT;
     else
         return BAD_REQUEST;
 
@@ -320,10 +457,13 @@ http_conn::HTTP_CODE http_conn::parse_request_line(char *text)
 
     if (!m_url || m_url[0] != '/')
         return BAD_REQUEST;
-    // 当url为/时，显示主页
-    if (strlen(m_url) == 1)
-        // strcat字符串追加
-        strcat(m_url, "judge.html"); // 主页面为judge.html
+    // 主页等固定页面、登录注册和上传都由路由表确定，其余按静态文件处理
+    m_route = http_route(m_url, strlen(m_url));
+
+    // /upload/下的PUT和POST为上传请求，请求体不放入读缓冲区，边收边写入文件；PUT只能用于上传
+    m_upload = (m_method == PUT || m_method == POST) && m_route && m_route->action == ROUTE_UPLOAD;
+    if (m_method == PUT && !m_upload)
+        return BAD_REQUEST;
 
     m_check_state = CHECK_STATE_HEADER; // 解析完毕，改变主状态机的状态
     return NO_REQUEST;
@@ -334,51 +474,116 @@ http_conn::HTTP_CODE http_conn::parse_headers(char *text)
 {
     if (text[0] == '\0')
     {
-        if (m_content_length != 0)
+        if (m_content_length != 0 || m_upload)
         {
             m_check_state = CHECK_STATE_CONTENT;
             return NO_REQUEST;
         }
         return GET_REQUEST;
     }
-    /*
-    strncasecmp(const char* str1, const char* str2, size_t n);
-    用来比较字符串str1和str2的前n个字符,相同返回0
-    */
-    else if (strncasecmp(text, "Connection:", 11) == 0)
+
+    // parse_line()刚把该行末尾的\r\n替换为\0\0，行尾就在m_checked_idx之前两个字节
+    const char *end = m_read_buf + m_checked_idx - 2;
+    char *colon = (char *)http_scan(text, end, ':', ':');
+    if (colon == end) // 没有分隔符，忽略
+        return NO_REQUEST;
+    char *value = colon + 1;
+    value += strspn(value, " \t");
+    char *value_end = (char *)end;
+    while (value_end > value && (value_end[-1] == ' ' || value_end[-1] == '\t'))
+        --value_end;
+    *value_end = '\0';
+    *colon = '\0';
+
+    // 首部名经完美哈希直接定位到对应的处理，不再依次strncasecmp
+    HTTP_HEADER id = http_header_lookup(text, colon - text);
+    add_header(id, text, colon - text, value, value_end - value);
+    switch (id)
+    {
+    case HEADER_CONNECTION:
     {
-        text += 11;
-        text += strspn(text, " \t");
-        if (strcasecmp(text, "keep-alive") == 0)
+        if (strcasecmp(value, "keep-alive") == 0)
         {
             m_linger = true;
         }
+        break;
     }
-    else if (strncasecmp(text, "Content-length:", 15) == 0)
+    case HEADER_CONTENT_LENGTH:
     {
-        text += 15;
-        text += strspn(text, " \t");
-        m_content_length = atol(text);
+        // 只接受十进制数字：负数、溢出和多余的字符都是错误，请求体会被当作下一个请求的开头
+        // 非上传请求的请求体要整个放入读缓冲区，不能超过缓冲区的上限
+        char *digits_end = NULL;
+        errno = 0;
+        long length = strtol(value, &digits_end, 10);
+        if (!isdigit((unsigned char)value[0]) || *digits_end != '\0' || errno == ERANGE)
+            return BAD_REQUEST;
+        if (!m_upload && length > buffer_pool::get_instance()->max_size())
+            return BAD_REQUEST;
+        m_content_length = length;
+        break;
     }
-    else if (strncasecmp(text, "Host:", 5) == 0)
+    case HEADER_HOST:
     {
-        text += 5;
-        text += strspn(text, " \t");
-        m_host = text;
+        m_host = value;
+        break;
+    }
+    default:
+        break;
     }
-    // else
-    // {
-    //     LOG_INFO("oop!unknow header: %s", text);
-    // }
     return NO_REQUEST;
 }
 
+// 记录首部的位置，常用首部同时记下标，重复出现时以第一个为准
+void http_conn::add_header(HTTP_HEADER id, char *name, int name_len, char *value, int value_len)
+{
+    if (m_header_count >= MAX_HEADERS)
+        return;
+    header_field &field = m_headers[m_header_count];
+    field.name = name - m_read_buf;
+    field.name_len = name_len;
+    field.value = value - m_read_buf;
+    field.value_len = value_len;
+    if (id != HEADER_UNKNOWN && m_known[id] < 0)
+        m_known[id] = m_header_count;
+    ++m_header_count;
+}
+
+const char *http_conn::get_header(HTTP_HEADER id, int *len)
+{
+    if (m_known[id] < 0)
+        return NULL;
+    const header_field &field = m_headers[m_known[id]];
+    if (len)
+        *len = field.value_len;
+    return m_read_buf + field.value;
+}
+
+const char *http_conn::find_header(const char *name, int *len)
+{
+    int name_len = strlen(name);
+    HTTP_HEADER id = http_header_lookup(name, name_len);
+    if (id != HEADER_UNKNOWN)
+        return get_header(id, len);
+    for (int i = 0; i < m_header_count; ++i)
+    {
+        const header_field &field = m_headers[i];
+        if (field.name_len == name_len && strncasecmp(m_read_buf + field.name, name, name_len) == 0)
+        {
+            if (len)
+                *len = field.value_len;
+            return m_read_buf + field.value;
+        }
+    }
+    return NULL;
+}
+
 // 判断http请求是否被完整读入
 // 解析请求体
 http_conn::HTTP_CODE http_conn::parse_content(char *text)
 {
     if (m_read_idx >= (m_content_length + m_checked_idx))
     {
+        m_body_end = text[m_content_length];
         text[m_content_length] = '\0';
         // POST请求中最后为输入的用户名和密码
         m_string = text;
@@ -387,6 +592,159 @@ http_conn::HTTP_CODE http_conn::parse_content(char *text)
     return NO_REQUEST;
 }
 
+// 上传请求的请求体：读缓冲区中已有的部分交给on_body()后移出缓冲区，其后的流水线数据前移
+// 请求体收齐时完成上传，出错时不再保持连接，未读的请求体随连接一起丢弃
+http_conn::HTTP_CODE http_conn::parse_upload()
+{
+    if (m_body_fd < 0)
+    {
+        HTTP_CODE ret = begin_upload();
+        if (ret != NO_REQUEST)
+        {
+            m_linger = false;
+            return ret;
+        }
+    }
+
+    long len = m_read_idx - m_checked_idx;
+    if (len > m_body_remain)
+        len = m_body_remain;
+    if (len > 0)
+    {
+        if (!on_body(m_read_buf + m_checked_idx, len))
+        {
+            abort_upload();
+            m_linger = false;
+            return INTERNAL_ERROR;
+        }
+        memmove(m_read_buf + m_checked_idx, m_read_buf + m_checked_idx + len, m_read_idx - m_checked_idx - len);
+        m_read_idx -= len;
+    }
+    if (m_body_remain > 0)
+        return NO_REQUEST;
+    return finish_upload();
+}
+
+// 目标文件为资源目录下的upload/文件名，文件名不能含'/'或以'.'开头
+http_conn::HTTP_CODE http_conn::begin_upload()
+{
+    const char *name = m_url + m_route->len;
+    if (name[0] == '\0' || name[0] == '.' || strchr(name, '/'))
+        return BAD_REQUEST;
+    // 不支持分块传输，没有Content-Length时无法判断请求体在哪里结束，在创建文件之前拒绝
+    if (find_header("Transfer-Encoding"))
+        return BAD_REQUEST;
+    if (!get_header(HEADER_CONTENT_LENGTH))
+        return LENGTH_REQUIRED;
+
+    int len = snprintf(m_real_file, FILENAME_LEN, "%s/upload", doc_root);
+    if (len >= FILENAME_LEN || (mkdir(m_real_file, 0755) < 0 && errno != EEXIST))
+        return INTERNAL_ERROR;
+    len = snprintf(m_real_file, FILENAME_LEN, "%s/upload/%s", doc_root, name);
+    int tmp_len = snprintf(m_upload_tmp, FILENAME_LEN, "%s/upload/.%s.part", doc_root, name);
+    if (len >= FILENAME_LEN || tmp_len >= FILENAME_LEN)
+        return BAD_REQUEST;
+
+    m_body_fd = open(m_upload_tmp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (m_body_fd < 0)
+        return INTERNAL_ERROR;
+    m_body_remain = m_content_length;
+    return NO_REQUEST;
+}
+
+// 上传数据的处理者，目前直接追加写入临时文件
+bool http_conn::on_body(const char *data, int len)
+{
+    while (len > 0)
+    {
+        int ret = ::write(m_body_fd, data, len);
+        if (ret < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            return false;
+        }
+        data += ret;
+        len -= ret;
+        m_body_remain -= ret;
+    }
+    return true;
+}
+
+http_conn::HTTP_CODE http_conn::finish_upload()
+{
+    int fd = m_body_fd;
+    m_body_fd = -1;
+    if (close(fd) < 0 || rename(m_upload_tmp, m_real_file) < 0)
+    {
+        unlink(m_upload_tmp);
+        m_linger = false;
+        return INTERNAL_ERROR;
+    }
+    if (m_pipe[0] >= 0)
+    {
+        close(m_pipe[0]);
+        close(m_pipe[1]);
+        m_pipe[0] = m_pipe[1] = -1;
+    }
+    return UPLOAD_REQUEST;
+}
+
+void http_conn::abort_upload()
+{
+    if (m_body_fd >= 0)
+    {
+        close(m_body_fd);
+        unlink(m_upload_tmp);
+        m_body_fd = -1;
+    }
+    if (m_pipe[0] >= 0)
+    {
+        close(m_pipe[0]);
+        close(m_pipe[1]);
+        m_pipe[0] = m_pipe[1] = -1;
+    }
+}
+
+// 请求体经管道splice到文件，数据不经过用户态；io_uring模式下仍由recv读入缓冲区再写入
+// 与read_once()一样，LT模式每次只读一轮，ET模式读到EAGAIN为止
+bool http_conn::splice_body()
+{
+    if (m_pipe[0] < 0 && pipe2(m_pipe, O_NONBLOCK | O_CLOEXEC) < 0)
+    {
+        m_pipe[0] = m_pipe[1] = -1;
+        abort_upload();
+        return false;
+    }
+    while (m_body_remain > 0)
+    {
+        size_t chunk = m_body_remain < SPLICE_CHUNK ? m_body_remain : SPLICE_CHUNK;
+        ssize_t bytes = splice(m_sockfd, NULL, m_pipe[1], NULL, chunk, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+        if (bytes < 0 && errno == EAGAIN) // 没有数据了
+            break;
+        if (bytes <= 0) // 对方关闭连接或出错
+        {
+            abort_upload();
+            return false;
+        }
+        // 管道中的数据全部写入文件，管道读端不会阻塞
+        while (bytes > 0)
+        {
+            ssize_t written = splice(m_pipe[0], NULL, m_body_fd, NULL, bytes, SPLICE_F_MOVE);
+            if (written <= 0)
+            {
+                abort_upload();
+                return false;
+            }
+            bytes -= written;
+            m_body_remain -= written;
+        }
+        if (0 == m_TRIGMode)
+            break;
+    }
+    return true;
+}
+
 // 主状态机，解析请求
 http_conn::HTTP_CODE http_conn::process_read()
 {
@@ -398,7 +756,9 @@ http_conn::HTTP_CODE http_conn::process_read()
 
     // 循环解析并处理每一行数据
     /*while进入条件：解析到了请求体并且是完整数据，或者解析到了一行完整的数据*/
-    while ((m_check_state == CHECK_STATE_CONTENT && line_status == LINE_OK) || ((line_status = parse_line()) == LINE_OK))
+    /*请求体不按行解析，不完整时不能调用parse_line()，否则m_checked_idx会越过请求体，之后读到的数据再也凑不齐*/
+    while ((m_check_state == CHECK_STATE_CONTENT && line_status == LINE_OK) ||
+           (m_check_state != CHECK_STATE_CONTENT && (line_status = parse_line()) == LINE_OK))
     {
         text = get_line();            // 获取一行数据
         m_start_line = m_checked_idx; // 更新当前解析位置
@@ -426,6 +786,14 @@ http_conn::HTTP_CODE http_conn::process_read()
         }
         case CHECK_STATE_CONTENT:
         {
+            if (m_upload)
+            {
+                ret = parse_upload();
+                if (ret != NO_REQUEST)
+                    return ret;
+                line_status = LINE_OPEN;
+                break;
+            }
             ret = parse_content(text);
             if (ret == GET_REQUEST)
                 return do_request(); // 解析具体的请求信息
@@ -439,173 +807,430 @@ http_conn::HTTP_CODE http_conn::process_read()
     return NO_REQUEST;
 }
 
-// 处理具体请求
-http_conn::HTTP_CODE http_conn::do_request()
+// 把src接在dst已有的len个字节之后，超出size时截断，结尾总是写入'\0'
+// 连接复用时m_real_file不再清零，拼接路径不能依赖缓冲区中原有的'\0'
+static void append_path(char *dst, int len, int size, const char *src)
 {
-    strcpy(m_real_file, doc_root);
-    int len = strlen(doc_root);
-    // printf("m_url:%s\n", m_url);
-    // 查找一个字符‘/’在另一个字符串m_url中末次出现的位置（也就是从m_url的右侧开始查找字符/首次出现的位置），并返回这个位置的地址。
-    const char *p = strrchr(m_url, '/');
-
-    // 处理cgi
-    if (cgi == 1 && (*(p + 1) == '2' || *(p + 1) == '3'))
-    {
-
-        // 根据标志判断是登录检测还是注册检测
-        char flag = m_url[1];
-
-        char *m_url_real = (char *)malloc(sizeof(char) * 200);
-        strcpy(m_url_real, "/");
-        strcat(m_url_real, m_url + 2);
-        strncpy(m_real_file + len, m_url_real, FILENAME_LEN - len - 1);
-        free(m_url_real);
-
-        // 将用户名和密码提取出来
-        // user=123&passwd=123
-        char name[100], password[100];
-        int i;
-        for (i = 5; m_string[i] != '&'; ++i)
-            name[i - 5] = m_string[i];
-        name[i - 5] = '\0';
-
-        int j = 0;
-        for (i = i + 10; m_string[i] != '\0'; ++i, ++j)
-            password[j] = m_string[i];
-        password[j] = '\0';
-
-        if (*(p + 1) == '3')
-        {
-            // 如果是注册，先检测数据库中是否有重名的
-            // 没有重名的，进行增加数据
-            char *sql_insert = (char *)malloc(sizeof(char) * 200);
-            strcpy(sql_insert, "INSERT INTO user(username, passwd) VALUES(");
-            strcat(sql_insert, "'");
-            strcat(sql_insert, name);
-            strcat(sql_insert, "', '");
-            strcat(sql_insert, password);
-            strcat(sql_insert, "')");
-
-            if (users.find(name) == users.end())
+    int n = strlen(src);
+    if (n > size - len - 1)
+        n = size - len - 1;
+    memcpy(dst + len, src, n);
+    dst[len + n] = '\0';
+}
+
+// 解析Accept-Encoding的值，返回客户端接受的预压缩格式
+// 只区分q值是否为0，q=0表示拒绝该格式
+static int accepted_encodings(const char *value, int len)
+{
+    int accepted = 0, rejected = 0;
+    bool any = false; // "*"且q值不为0
+    const char *p = value, *end = value + len;
+    while (p < end)
+    {
+        while (p < end && (*p == ' ' || *p == '\t' || *p == ','))
+            ++p;
+        const char *token = p;
+        while (p < end && *p != ',' && *p != ';' && *p != ' ' && *p != '\t')
+            ++p;
+        int token_len = p - token;
+        int encoding = 0;
+        if (token_len == 4 && strncasecmp(token, "gzip", 4) == 0)
+            encoding = ENCODING_GZIP;
+        else if (token_len == 2 && strncasecmp(token, "br", 2) == 0)
+            encoding = ENCODING_BR;
+        bool star = token_len == 1 && *token == '*';
+
+        // 参数部分只关心q值是否为0，如"gzip;q=0"、"br;q=0.000"
+        bool zero = false;
+        for (; p < end && *p != ','; ++p)
+        {
+            if ((*p == 'q' || *p == 'Q') && p + 2 < end && p[1] == '=')
             {
-                m_lock.lock();
-                int res = mysql_query(mysql, sql_insert);
-                users.insert(pair<string, string>(name, password));
-                m_lock.unlock();
-
-                if (!res)
-                    strcpy(m_url, "/log.html");
-                else
-                    strcpy(m_url, "/registerError.html");
+                zero = true;
+                for (p += 2; p < end && *p != ',' && *p != ';' && *p != ' '; ++p)
+                    if (*p != '0' && *p != '.')
+                        zero = false;
+                --p;
             }
-            else
-                strcpy(m_url, "/registerError.html");
         }
-        // 如果是登录，直接判断
-        // 若浏览器端输入的用户名和密码在表中可以查找到，返回1，否则返回0
-        else if (*(p + 1) == '2')
+        if (star)
+            any = !zero;
+        else if (zero)
+            rejected |= encoding;
+        else
+            accepted |= encoding;
+    }
+    // "*"代表其余未列出的格式，单独列出并被拒绝的不使用
+    if (any)
+        accepted |= ENCODING_GZIP | ENCODING_BR;
+    return accepted & ~rejected;
+}
+
+// 文件有预压缩版本时调用，按Accept-Encoding把m_file换成.br或.gz文件
+void http_conn::negotiate_encoding()
+{
+    m_vary = true;
+    int len = 0;
+    const char *value = get_header(HEADER_ACCEPT_ENCODING, &len);
+    if (!value)
+        return;
+    int usable = accepted_encodings(value, len) & m_file->encodings;
+    if (!usable)
+        return;
+
+    // br压缩率更高，两者都可用时优先
+    int encoding = (usable & ENCODING_BR) ? ENCODING_BR : ENCODING_GZIP;
+    char path[FILENAME_LEN + 4];
+    int n = strlen(m_real_file);
+    memcpy(path, m_real_file, n);
+    memcpy(path + n, encoding == ENCODING_BR ? ".br" : ".gz", 4);
+
+    file_entry *encoded = NULL;
+    if (file_cache::get_instance()->acquire(path, encoded) != file_cache::FILE_OK)
+        return; // 预压缩文件刚被删除，仍发送原文件
+    file_cache::get_instance()->release(m_file);
+    m_file = encoded;
+    m_encoding = encoding;
+}
+
+// If-None-Match的值是否包含etag，按弱比较忽略W/前缀，"*"匹配任何存在的文件
+static bool etag_matches(const char *value, int len, const char *etag, int etag_len)
+{
+    const char *p = value, *end = value + len;
+    while (p < end)
+    {
+        while (p < end && (*p == ' ' || *p == '\t' || *p == ','))
+            ++p;
+        if (p == end)
+            break;
+        if (*p == '*')
+            return true;
+        if (end - p >= 2 && p[0] == 'W' && p[1] == '/')
+            p += 2;
+        const char *tag = p;
+        if (p < end && *p == '"')
+        {
+            // 带引号的值中可能出现','，找到配对的引号为止
+            const char *close = (const char *)memchr(p + 1, '"', end - p - 1);
+            p = close ? close + 1 : end;
+        }
+        else
         {
-            if (users.find(name) != users.end() && users[name] == password)
-                strcpy(m_url, "/welcome.html");
-            else
-                strcpy(m_url, "/logError.html");
+            while (p < end && *p != ',')
+                ++p;
         }
+        if (p - tag == etag_len && memcmp(tag, etag, etag_len) == 0)
+            return true;
+        while (p < end && *p != ',')
+            ++p;
     }
+    return false;
+}
 
-    if (*(p + 1) == '0')
-    {
-        char *m_url_real = (char *)malloc(sizeof(char) * 200);
-        strcpy(m_url_real, "/register.html");
-        strncpy(m_real_file + len, m_url_real, strlen(m_url_real));
+// 条件请求：有If-None-Match时只比较ETag，否则比较If-Modified-Since与文件的修改时间
+bool http_conn::not_modified()
+{
+    int len = 0;
+    const char *value = get_header(HEADER_IF_NONE_MATCH, &len);
+    if (value)
+        return etag_matches(value, len, m_file->etag, m_file->etag_len);
 
-        free(m_url_real);
-    }
-    else if (*(p + 1) == '1')
-    {
-        char *m_url_real = (char *)malloc(sizeof(char) * 200);
-        strcpy(m_url_real, "/log.html");
-        strncpy(m_real_file + len, m_url_real, strlen(m_url_real));
+    value = get_header(HEADER_IF_MODIFIED_SINCE);
+    if (!value)
+        return false;
+    // 浏览器带回的是之前响应中的Last-Modified，首部值已以'\0'结尾
+    struct tm tm;
+    memset(&tm, 0, sizeof(tm));
+    if (!strptime(value, "%a, %d %b %Y %H:%M:%S GMT", &tm))
+        return false;
+    return m_file->st.st_mtime <= timegm(&tm);
+}
 
-        free(m_url_real);
-    }
-    else if (*(p + 1) == '5')
-    {
-        char *m_url_real = (char *)malloc(sizeof(char) * 200);
-        strcpy(m_url_real, "/picture.html");
-        strncpy(m_real_file + len, m_url_real, strlen(m_url_real));
+// 解析一个不超过18位的十进制数，没有数字时返回false
+static bool parse_offset(const char *&p, const char *end, off_t &value)
+{
+    const char *begin = p;
+    value = 0;
+    while (p < end && *p >= '0' && *p <= '9' && p - begin < 18)
+        value = value * 10 + (*p++ - '0');
+    return p > begin && (p == end || *p < '0' || *p > '9');
+}
 
-        free(m_url_real);
-    }
-    else if (*(p + 1) == '6')
-    {
-        char *m_url_real = (char *)malloc(sizeof(char) * 200);
-        strcpy(m_url_real, "/video.html");
-        strncpy(m_real_file + len, m_url_real, strlen(m_url_real));
+// If-Range是ETag时按强比较，是日期时必须与Last-Modified完全相同，不一致时忽略Range发送整个文件
+bool http_conn::range_applies()
+{
+    int len = 0;
+    const char *value = get_header(HEADER_IF_RANGE, &len);
+    if (!value)
+        return true;
+    if (value[0] == '"')
+        return len == m_file->etag_len && memcmp(value, m_file->etag, len) == 0;
+    if (value[0] == 'W' && value[1] == '/')
+        return false;
+    struct tm tm;
+    memset(&tm, 0, sizeof(tm));
+    if (!strptime(value, "%a, %d %b %Y %H:%M:%S GMT", &tm))
+        return false;
+    return m_file_stat.st_mtime == timegm(&tm);
+}
 
-        free(m_url_real);
-    }
-    else if (*(p + 1) == '7')
+// 解析Range首部(bytes=a-b, a-, -n)，可满足的范围依次存入m_range_first/m_range_last
+// 返回可满足的范围数；没有Range、格式不对、范围过多或重叠部分过多时返回0，按普通请求发送整个文件
+// 所有范围都超出文件大小时返回-1
+int http_conn::parse_range()
+{
+    int len = 0;
+    const char *value = get_header(HEADER_RANGE, &len);
+    if (!value || len < 6 || strncasecmp(value, "bytes=", 6) != 0 || !range_applies())
+        return 0;
+
+    off_t size = m_file_stat.st_size;
+    off_t total = 0;
+    int specs = 0, count = 0;
+    const char *p = value + 6, *end = value + len;
+    while (p < end)
     {
-        char *m_url_real = (char *)malloc(sizeof(char) * 200);
-        strcpy(m_url_real, "/other.html");
-        strncpy(m_real_file + len, m_url_real, strlen(m_url_real));
+        while (p < end && (*p == ' ' || *p == '\t' || *p == ','))
+            ++p;
+        if (p == end)
+            break;
+        ++specs;
 
-        free(m_url_real);
+        off_t first, last;
+        if (*p == '-')
+        {
+            // 最后n个字节
+            off_t suffix;
+            ++p;
+            if (!parse_offset(p, end, suffix))
+                return 0;
+            first = suffix < size ? size - suffix : 0;
+            last = suffix > 0 ? size - 1 : -1;
+        }
+        else
+        {
+            if (!parse_offset(p, end, first) || p == end || *p++ != '-')
+                return 0;
+            last = size - 1;
+            if (p < end && *p >= '0' && *p <= '9')
+            {
+                if (!parse_offset(p, end, last) || last < first)
+                    return 0;
+                if (last >= size)
+                    last = size - 1;
+            }
+        }
+        while (p < end && (*p == ' ' || *p == '\t'))
+            ++p;
+        if (p < end && *p != ',')
+            return 0;
+
+        if (first >= size || last < first) // 无法满足，跳过
+            continue;
+        if (count == MAX_RANGES)
+            return 0;
+        m_range_first[count] = first;
+        m_range_last[count] = last;
+        ++count;
+        total += last - first + 1;
     }
-    else if (*(p + 1) == '9')
-    {
-        char *m_url_real = (char *)malloc(sizeof(char) * 200);
-        strcpy(m_url_real, "/mytest.html");
-        strncpy(m_real_file + len, m_url_real, strlen(m_url_real));
+    if (specs == 0 || total > size)
+        return 0;
+    return count > 0 ? count : -1;
+}
+
+// 按路由分派，下标为ROUTE_ACTION
+const http_conn::route_handler http_conn::route_handlers[ROUTE_COUNT] = {
+    &http_conn::serve_static,   // ROUTE_STATIC
+    &http_conn::serve_page,     // ROUTE_PAGE
+    &http_conn::check_login,    // ROUTE_LOGIN
+    &http_conn::check_register, // ROUTE_REGISTER
+    &http_conn::serve_static,   // ROUTE_UPLOAD，上传在读取请求体时已完成，这里只有GET上传的文件
+};
+
+// 处理具体请求
+http_conn::HTTP_CODE http_conn::do_request()
+{
+    return (this->*route_handlers[m_route ? m_route->action : ROUTE_STATIC])();
+}
+
+// 资源目录下与url同名的文件
+http_conn::HTTP_CODE http_conn::serve_static()
+{
+    return serve_file(m_url);
+}
+
+// 路由指定的页面
+http_conn::HTTP_CODE http_conn::serve_page()
+{
+    return serve_file(m_route->target);
+}
 
-        free(m_url_real);
+// 从POST请求体中就地取出用户名和密码：'&'被替换为'\0'，两者都直接指向请求体，不复制
+// user=123&password=123
+bool http_conn::parse_credentials(char *&name, char *&password)
+{
+    if (cgi != 1 || !m_string || strncmp(m_string, "user=", 5) != 0)
+        return false;
+    name = m_string + 5;
+    char *amp = strchrnul(name, '&');
+    if (strncmp(amp, "&password=", 10) != 0)
+        return false;
+    *amp = '\0';
+    password = amp + 10;
+    return true;
+}
+
+// 登录检测：若浏览器端输入的用户名和密码在表中可以查找到，发送欢迎页，否则发送错误页
+http_conn::HTTP_CODE http_conn::check_login()
+{
+    char *name, *password;
+    if (!parse_credentials(name, password))
+        return serve_static();
+
+    // users的比较器支持直接用char*查找，不构造临时string
+    user_map::iterator it = users.find(name);
+    if (it != users.end() && it->second == password)
+        return serve_file("/welcome.html");
+    return serve_file("/logError.html");
+}
+
+// 注册检测：先检测数据库中是否有重名的，没有重名的，进行增加数据
+http_conn::HTTP_CODE http_conn::check_register()
+{
+    char *name, *password;
+    if (!parse_credentials(name, password))
+        return serve_static();
+
+    const char *page = "/registerError.html";
+    if (users.find(name) == users.end())
+    {
+        // 只有注册需要数据库，用到时才从连接池取，处理其他请求的线程和事件循环都不占用连接
+        MYSQL *mysql = NULL;
+        connectionRAII mysqlcon(&mysql, connection_pool::GetInstance());
+
+        // 用户名和密码转义后拼进SQL语句，语句从本次请求的arena分配，转义最多使长度翻倍
+        static const char prefix[] = "INSERT INTO user(username, passwd) VALUES('";
+        size_t name_len = strlen(name), password_len = strlen(password);
+        char *sql_insert = (char *)m_arena.alloc(sizeof(prefix) + 2 * (name_len + password_len) + 8);
+        if (!sql_insert)
+            return INTERNAL_ERROR;
+        char *p = sql_insert;
+        memcpy(p, prefix, sizeof(prefix) - 1);
+        p += sizeof(prefix) - 1;
+        p += mysql_real_escape_string(mysql, p, name, name_len);
+        memcpy(p, "', '", 4);
+        p += 4;
+        p += mysql_real_escape_string(mysql, p, password, password_len);
+        memcpy(p, "')", 3);
+
+        m_lock.lock();
+        int res = mysql_query(mysql, sql_insert);
+        users.insert(pair<string, string>(name, password));
+        m_lock.unlock();
+
+        if (!res)
+            page = "/log.html";
     }
+    return serve_file(page);
+}
 
-    else
-        strncpy(m_real_file + len, m_url, FILENAME_LEN - len - 1);
+// 发送资源目录下的path，处理预压缩、条件请求和Range
+http_conn::HTTP_CODE http_conn::serve_file(const char *path)
+{
+    strcpy(m_real_file, doc_root);
+    append_path(m_real_file, strlen(doc_root), FILENAME_LEN, path);
 
-    if (stat(m_real_file, &m_file_stat) < 0)
+    // 从文件缓存中获取文件的映射和属性，命中时不再stat、open、mmap
+    switch (file_cache::get_instance()->acquire(m_real_file, m_file))
+    {
+    case file_cache::FILE_OK:
+        break;
+    case file_cache::FILE_NOT_FOUND:
         return NO_RESOURCE;
-
-    if (!(m_file_stat.st_mode & S_IROTH))
+    case file_cache::FILE_FORBIDDEN:
         return FORBIDDEN_REQUEST;
-
-    // 判断是否是目录
-    if (S_ISDIR(m_file_stat.st_mode))
+    case file_cache::FILE_IS_DIR:
         return BAD_REQUEST;
-
-    // 以只读的方式打开文件
-    int fd = open(m_real_file, O_RDONLY);
-    // 创建内存映射
-    m_file_address = (char *)mmap(0, m_file_stat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
-    close(fd);
+    default:
+        return INTERNAL_ERROR;
+    }
+    m_mime = m_file->mime;
+    if (m_file->encodings)
+        negotiate_encoding();
+    // 校验值按实际发送的文件(原文件或预压缩文件)比较
+    if (not_modified())
+        return NOT_MODIFIED;
+    m_file_address = m_file->address;
+    m_file_stat = m_file->st;
+
+    m_range_count = parse_range();
+    if (m_range_count > 0)
+        return PARTIAL_CONTENT;
+    if (m_range_count < 0)
+        return RANGE_NOT_SATISFIABLE;
     return FILE_REQUEST;
 }
-// 对内存映射区执行munmap操作，释放映射
+// 释放当前请求的文件，已经转入发送队列的文件由unmap或发送完成时释放
+void http_conn::release_file()
+{
+    if (!m_file)
+        return;
+    file_cache::get_instance()->release(m_file);
+    m_file = NULL;
+    m_file_address = 0;
+}
+// 释放对缓存文件的引用，最后一个引用释放时由缓存执行munmap
 void http_conn::unmap()
 {
-    if (m_file_address)
-    {
-        munmap(m_file_address, m_file_stat.st_size);
-        m_file_address = 0;
-    }
+    file_cache *cache = file_cache::get_instance();
+    release_file();
+    for (int i = 0; i < m_file_count; ++i)
+        cache->release(m_files[i]);
+    m_file_count = 0;
 }
 
-// 写响应数据
+// 写响应数据，发送队列中可能有多个流水线请求的响应，一次writev发出
 bool http_conn::write()
 {
     int temp = 0;
 
+    // 先重置连接状态再重新注册EPOLLIN，Reactor模式下注册后其他工作线程可能立即开始读取
     if (bytes_to_send == 0)
     {
-        modfd(m_epollfd, m_sockfd, EPOLLIN, m_TRIGMode);
         init();
+        modfd(m_epollfd, m_sockfd, EPOLLIN, m_TRIGMode);
         return true;
     }
 
     while (1)
     {
-        temp = writev(m_sockfd, m_iv, m_iv_count);
+        if (m_iv_idx < m_iv_count)
+        {
+            // 队列末尾还有sendfile发送的文件时带MSG_MORE，内核等文件数据到来后合并成完整的报文段再发出
+            if (m_sendfile_fd < 0)
+            {
+                temp = writev(m_sockfd, m_iv + m_iv_idx, m_iv_count - m_iv_idx);
+            }
+            else
+            {
+                struct msghdr msg;
+                memset(&msg, 0, sizeof(msg));
+                msg.msg_iov = m_iv + m_iv_idx;
+                msg.msg_iovlen = m_iv_count - m_iv_idx;
+                temp = sendmsg(m_sockfd, &msg, MSG_MORE);
+            }
+        }
+        // 文件直接从页缓存发送，EAGAIN后从m_sendfile_offset继续
+        else
+        {
+            temp = sendfile(m_sockfd, m_sendfile_fd, &m_sendfile_offset, bytes_to_send);
+            if (temp == 0) // 文件在发送途中被截断
+            {
+                unmap();
+                return false;
+            }
+        }
 
         if (temp < 0)
         {
@@ -618,174 +1243,522 @@ bool http_conn::write()
             return false;
         }
 
-        bytes_have_send += temp;
-        bytes_to_send -= temp;
-        if (bytes_have_send >= m_iv[0].iov_len)
-        {
-            m_iv[0].iov_len = 0;
-            m_iv[1].iov_base = m_file_address + (bytes_have_send - m_write_idx);
-            m_iv[1].iov_len = bytes_to_send;
-        }
-        else
-        {
-            m_iv[0].iov_base = m_write_buf + bytes_have_send;
-            m_iv[0].iov_len = m_iv[0].iov_len - bytes_have_send;
-        }
+        update_iov(temp);
 
         if (bytes_to_send <= 0)
         {
             unmap();
-            modfd(m_epollfd, m_sockfd, EPOLLIN, m_TRIGMode);
 
-            if (m_linger)
+            if (m_keep_alive)
             {
-                init();
+                reset_response();
+                // 读缓冲区中还有流水线请求，由调用者再次process()，处理完再注册事件
+                if (m_read_idx > 0)
+                {
+                    m_pipelined = true;
+                    return true;
+                }
+                // 连接空闲，读缓冲区还给缓冲区池，下次有数据时再取
+                release_read_buf();
+                modfd(m_epollfd, m_sockfd, EPOLLIN, m_TRIGMode);
                 return true;
             }
             else
             {
+                release_read_buf();
                 return false;
             }
         }
     }
 }
 
-bool http_conn::add_response(const char *format, ...)
+// 已发送bytes字节，跳过发送队列中已发完的部分
+void http_conn::update_iov(int bytes)
 {
-    // 如果当前索引大于写缓冲区大小
-    if (m_write_idx >= WRITE_BUFFER_SIZE)
-        return false;
-    va_list arg_list;
-    va_start(arg_list, format);
-    /*
-    int vsnprintf(char *str, size_t size, const char *format, va_list ap);
-    作用：将可变参数格式化输出到一个字符数组
-        str:保存输出字符数组的存储区。
-        size:存储区的大小。
-        format:包含格式字符串的C字符串，其格式字符串与printf中的格式相同
-        arg:变量参数列表，用va_list 定义。
-    */
-    // 将响应数据写入m_write_buf
-    int len = vsnprintf(m_write_buf + m_write_idx, WRITE_BUFFER_SIZE - 1 - m_write_idx, format, arg_list);
-    if (len >= (WRITE_BUFFER_SIZE - 1 - m_write_idx)) // 写不下
+    bytes_have_send += bytes;
+    bytes_to_send -= bytes;
+    while (bytes > 0 && m_iv_idx < m_iv_count)
     {
-        va_end(arg_list);
-        return false;
+        if ((size_t)bytes < m_iv[m_iv_idx].iov_len)
+        {
+            m_iv[m_iv_idx].iov_base = (char *)m_iv[m_iv_idx].iov_base + bytes;
+            m_iv[m_iv_idx].iov_len -= bytes;
+            return;
+        }
+        bytes -= m_iv[m_iv_idx].iov_len;
+        ++m_iv_idx;
     }
+}
+
+// io_uring模式下recv的目标位置
+char *http_conn::recv_buf(int &len)
+{
+    if (!reserve_read())
+        return NULL;
+    len = m_read_size - m_read_idx;
+    return m_read_buf + m_read_idx;
+}
+
+// io_uring模式下recv完成，与process()相同，只是不操作epoll，由返回值告诉事件循环下一步
+http_conn::URING_NEXT http_conn::recv_done(int bytes)
+{
+    m_read_idx += bytes;
+    if (may_block())
+        return URING_WORKER;
+    return uring_batch();
+}
+
+// 登录注册的POST要查询和写入数据库，上传要把请求体写入文件，这些请求不在事件循环线程内处理
+// 只检查请求方法，误判只是多经过一次线程池；GET的文件缓存在TTL到期后的stat仍在事件循环内完成
+bool http_conn::may_block()
+{
+    if (m_check_state != CHECK_STATE_REQUESTLINE && (m_method == POST || m_method == PUT))
+        return true;
+    // 尚未解析的请求行，包括流水线中后面的请求
+    const char *data = m_read_buf + m_start_line;
+    int len = m_read_idx - m_start_line;
+    return memmem(data, len, "POST ", 5) || memmem(data, len, "PUT ", 4);
+}
+
+http_conn::URING_NEXT http_conn::uring_batch()
+{
+    int queued = process_batch();
+    if (queued < 0)
+        return URING_CLOSE;
+    if (queued == 0) // 请求不完整，缓冲区已到上限时recv_buf()返回NULL，由事件循环关闭连接
+        return URING_RECV;
+    return URING_SEND;
+}
+
+struct iovec *http_conn::send_iov(int &count)
+{
+    count = m_iv_count - m_iv_idx;
+    return m_iv + m_iv_idx;
+}
+
+// io_uring模式下writev完成，bytes<0表示发送失败
+http_conn::URING_NEXT http_conn::send_done(int bytes)
+{
+    if (bytes < 0)
+    {
+        unmap();
+        return URING_CLOSE;
+    }
+
+    update_iov(bytes);
+    if (bytes_to_send > 0)
+        return URING_SEND;
+
+    unmap();
+    if (m_keep_alive)
+    {
+        reset_response();
+        // 读缓冲区中还有流水线请求，直接解析，不必等下一次recv
+        if (m_read_idx > 0)
+            return recv_done(0);
+        // 挂起的recv需要目标缓冲区，io_uring模式下不归还
+        return URING_RECV;
+    }
+    release_read_buf();
+    return URING_CLOSE;
+}
+
+// 响应头的各个片段都是已知长度的字符串，直接复制，不经过格式化
+bool http_conn::add_response(const char *data, int len)
+{
+    if (len > WRITE_BUFFER_SIZE - 1 - m_write_idx) // 写不下
+        return false;
+    memcpy(m_write_buf + m_write_idx, data, len);
     m_write_idx += len;
-    va_end(arg_list);
+    return true;
+}
 
-    LOG_INFO("request:%s", m_write_buf);
+// 十进制位数
+static int number_length(unsigned long value)
+{
+    int len = 1;
+    for (; value >= 10; value /= 10)
+        ++len;
+    return len;
+}
 
+// 每次转换两位十进制数，两个字符从表中一次取得
+bool http_conn::add_number(unsigned long value)
+{
+    static const char digits[] = "00010203040506070809101112131415161718192021222324252627282930313233343536373839404142434445464748495051525354555657585960616263646566676869707172737475767778798081828384858687888990919293949596979899";
+    char buf[20];
+    int pos = sizeof(buf);
+    while (value >= 100)
+    {
+        int i = (value % 100) * 2;
+        value /= 100;
+        buf[--pos] = digits[i + 1];
+        buf[--pos] = digits[i];
+    }
+    if (value >= 10)
+    {
+        buf[--pos] = digits[value * 2 + 1];
+        buf[--pos] = digits[value * 2];
+    }
+    else
+        buf[--pos] = '0' + value;
+    return add_response(buf + pos, sizeof(buf) - pos);
+}
+
+// Date首部精确到秒，每个线程缓存当前这一秒的内容，只在秒数变化时重新格式化
+bool http_conn::add_date()
+{
+    static thread_local time_t last = 0;
+    static thread_local char line[64];
+    static thread_local int line_len = 0;
+    time_t now = time(NULL);
+    if (now != last)
+    {
+        struct tm tm;
+        gmtime_r(&now, &tm);
+        line_len = strftime(line, sizeof(line), "Date: %a, %d %b %Y %H:%M:%S GMT\r\n", &tm);
+        last = now;
+    }
+    return add_response(line, line_len);
+}
+bool http_conn::add_content_encoding()
+{
+    if (m_encoding == ENCODING_GZIP)
+        return add_response(LITERAL("Content-Encoding: gzip\r\n"));
+    if (m_encoding == ENCODING_BR)
+        return add_response(LITERAL("Content-Encoding: br\r\n"));
     return true;
 }
-bool http_conn::add_status_line(int status, const char *title)
+bool http_conn::add_vary()
 {
-    return add_response("%s %d %s\r\n", "HTTP/1.1", status, title);
+    return !m_vary || add_response(LITERAL("Vary: Accept-Encoding\r\n"));
 }
-bool http_conn::add_headers(int content_len)
+bool http_conn::add_validators()
+{
+    return add_response(m_file->validators, m_file->validators_len);
+}
+bool http_conn::add_accept_ranges()
+{
+    return add_response(LITERAL("Accept-Ranges: bytes\r\n"));
+}
+bool http_conn::add_content_range(off_t first, off_t last)
+{
+    return add_response(LITERAL(content_range_prefix)) && add_number(first) && add_response(LITERAL("-")) &&
+           add_number(last) && add_response(LITERAL("/")) && add_number(m_file_stat.st_size) &&
+           add_response(LITERAL("\r\n"));
+}
+bool http_conn::add_status_line(const char *line, int len)
+{
+    return add_response(line, len) && add_date();
+}
+bool http_conn::add_headers(long content_len)
 {
     return add_content_length(content_len) && add_linger() && add_blank_line();
 }
-bool http_conn::add_content_length(int content_len)
+bool http_conn::add_content_length(long content_len)
 {
-    return add_response("Content-Length:%d\r\n", content_len);
+    return add_response(LITERAL("Content-Length: ")) && add_number(content_len) && add_response(LITERAL("\r\n"));
 }
-bool http_conn::add_content_type()
+bool http_conn::add_content_type(const mime_type *type)
 {
-    return add_response("Content-Type:%s\r\n", "text/html");
+    return add_response(type->header, type->header_len);
 }
 bool http_conn::add_linger()
 {
-    return add_response("Connection:%s\r\n", (m_linger == true) ? "keep-alive" : "close");
+    if (m_linger)
+        return add_response(LITERAL("Connection: keep-alive\r\n"));
+    return add_response(LITERAL("Connection: close\r\n"));
 }
 bool http_conn::add_blank_line()
 {
-    return add_response("%s", "\r\n");
+    return add_response(LITERAL("\r\n"));
 }
-bool http_conn::add_content(const char *content)
+bool http_conn::add_content(const char *content, int len)
 {
-    return add_response("%s", content);
+    return add_response(content, len);
 }
 
-// 根据服务器处理HTTP请求的结果，决定返回给客户端的内容
+// 根据服务器处理HTTP请求的结果，决定返回给客户端的内容，追加到发送队列末尾
 bool http_conn::process_write(HTTP_CODE ret)
 {
+    int start = m_write_idx; // 本响应的响应头在写缓冲区中的起始位置
+    // 发送队列放不下多范围响应时发送整个文件，服务器可以不理会Range
+    if (ret == PARTIAL_CONTENT && m_range_count > 1 && !can_queue_ranges())
+        ret = FILE_REQUEST;
     switch (ret)
     {
     case INTERNAL_ERROR:
     {
-        add_status_line(500, error_500_title);
-        add_headers(strlen(error_500_form));
-        if (!add_content(error_500_form))
+        add_status_line(LITERAL(error_500_status));
+        add_content_type(&mime_text_plain);
+        add_headers(sizeof(error_500_form) - 1);
+        if (!add_content(LITERAL(error_500_form)))
             return false;
         break;
     }
     case BAD_REQUEST:
     {
-        add_status_line(404, error_404_title);
-        add_headers(strlen(error_404_form));
-        if (!add_content(error_404_form))
+        add_status_line(LITERAL(error_404_status));
+        add_content_type(&mime_text_plain);
+        add_headers(sizeof(error_404_form) - 1);
+        if (!add_content(LITERAL(error_404_form)))
+            return false;
+        break;
+    }
+    case LENGTH_REQUIRED:
+    {
+        add_status_line(LITERAL(error_411_status));
+        add_content_type(&mime_text_plain);
+        add_headers(sizeof(error_411_form) - 1);
+        if (!add_content(LITERAL(error_411_form)))
             return false;
         break;
     }
     case FORBIDDEN_REQUEST:
     {
-        add_status_line(403, error_403_title);
-        add_headers(strlen(error_403_form));
-        if (!add_content(error_403_form))
+        add_status_line(LITERAL(error_403_status));
+        add_content_type(&mime_text_plain);
+        add_headers(sizeof(error_403_form) - 1);
+        if (!add_content(LITERAL(error_403_form)))
             return false;
         break;
     }
+    case UPLOAD_REQUEST:
+    {
+        add_status_line(LITERAL(ok_201_status));
+        add_content_type(&mime_text_plain);
+        add_headers(sizeof(ok_201_form) - 1);
+        if (!add_content(LITERAL(ok_201_form)))
+            return false;
+        break;
+    }
+    case NOT_MODIFIED:
+    {
+        // 只带校验值，没有响应体，文件不进入发送队列
+        if (!add_status_line(LITERAL(not_modified_304_status)) || !add_vary() || !add_validators() || !add_linger() ||
+            !add_blank_line())
+            return false;
+        release_file();
+        break;
+    }
+    case RANGE_NOT_SATISFIABLE:
+    {
+        // 告知客户端文件的实际大小，没有响应体
+        if (!add_status_line(LITERAL(error_416_status)) || !add_response(LITERAL(content_range_prefix)) ||
+            !add_response(LITERAL("*/")) || !add_number(m_file_stat.st_size) || !add_response(LITERAL("\r\n")) ||
+            !add_content_type(&mime_text_plain) || !add_headers(0))
+            return false;
+        release_file();
+        break;
+    }
+    case PARTIAL_CONTENT:
+    {
+        if (!add_status_line(LITERAL(partial_206_status)) || !add_content_encoding() || !add_vary() ||
+            !add_validators() || !add_accept_ranges())
+            return false;
+        if (m_range_count == 1)
+        {
+            off_t first = m_range_first[0], last = m_range_last[0];
+            if (!add_content_type(m_mime) || !add_content_range(first, last) || !add_headers(last - first + 1))
+                return false;
+            push_iov(m_write_buf + start, m_write_idx - start);
+            push_file(first, last - first + 1);
+            hold_file();
+            return true;
+        }
+
+        // 多个范围：multipart/byteranges，每段前是分隔行、Content-Type和Content-Range，数据直接引用文件映射
+        // 响应体长度需要先写入响应头，按各段首部的固定部分和数字位数算出
+        long body_len = sizeof(range_part_end) - 1;
+        for (int i = 0; i < m_range_count; ++i)
+            body_len += sizeof(range_part_begin) - 1 + m_mime->header_len + sizeof(content_range_prefix) - 1 +
+                        number_length(m_range_first[i]) + 1 + number_length(m_range_last[i]) + 1 +
+                        number_length(m_file_stat.st_size) + 4 + m_range_last[i] - m_range_first[i] + 1;
+        if (!add_response(LITERAL("Content-Type: multipart/byteranges; boundary=" RANGE_BOUNDARY "\r\n")) ||
+            !add_headers(body_len))
+            return false;
+        for (int i = 0; i < m_range_count; ++i)
+        {
+            if (!add_response(LITERAL(range_part_begin)) || !add_content_type(m_mime) || !add_content_range(m_range_first[i], m_range_last[i]) ||
+                !add_blank_line())
+                return false;
+            push_iov(m_write_buf + start, m_write_idx - start);
+            push_iov(m_file_address + m_range_first[i], m_range_last[i] - m_range_first[i] + 1);
+            start = m_write_idx;
+        }
+        if (!add_response(LITERAL(range_part_end)))
+            return false;
+        push_iov(m_write_buf + start, m_write_idx - start);
+        hold_file();
+        return true;
+    }
     case FILE_REQUEST:
     {
-        add_status_line(200, ok_200_title);
+        if (!add_status_line(LITERAL(ok_200_status)) || !add_content_encoding() || !add_vary() ||
+            !add_content_type(m_file_stat.st_size != 0 ? m_mime : &mime_text_html))
+            return false;
+        // 缓存中有预先生成的其余响应头和文件内容时直接发送，只需写入状态行和各请求不同的几个首部
+        if (m_file->response[m_linger])
+        {
+            push_iov(m_write_buf + start, m_write_idx - start);
+            push_iov(m_file->response[m_linger], m_file->response_len[m_linger]);
+            hold_file();
+            return true;
+        }
         if (m_file_stat.st_size != 0)
         {
-            add_headers(m_file_stat.st_size);
-            m_iv[0].iov_base = m_write_buf;
-            m_iv[0].iov_len = m_write_idx;
-            m_iv[1].iov_base = m_file_address;
-            m_iv[1].iov_len = m_file_stat.st_size;
-            m_iv_count = 2;
-            bytes_to_send = m_write_idx + m_file_stat.st_size;
+            if (!add_validators() || !add_accept_ranges() || !add_headers(m_file_stat.st_size))
+                return false;
+            push_iov(m_write_buf + start, m_write_idx - start);
+            push_file(0, m_file_stat.st_size);
+            hold_file();
             return true;
         }
         else
         {
-            const char *ok_string = "<html><body></body></html>";
-            add_headers(strlen(ok_string));
-            if (!add_content(ok_string))
+            add_headers(sizeof(empty_file_form) - 1);
+            if (!add_content(LITERAL(empty_file_form)))
                 return false;
+            // 空文件没有映射可发送，但缓存项的引用同样交给发送队列，下一个流水线请求取文件时不会覆盖丢失
+            hold_file();
         }
+        break;
     }
     default:
         return false;
     }
-    m_iv[0].iov_base = m_write_buf;
-    m_iv[0].iov_len = m_write_idx;
-    m_iv_count = 1;
-    bytes_to_send = m_write_idx;
+    push_iov(m_write_buf + start, m_write_idx - start);
     return true;
 }
 
+// 追加一段待发送数据，与上一段在内存中相连时合并(相邻响应的响应头都在m_write_buf中)
+void http_conn::push_iov(char *base, int len)
+{
+    bytes_to_send += len;
+    if (m_iv_count > 0)
+    {
+        struct iovec &last = m_iv[m_iv_count - 1];
+        if ((char *)last.iov_base + last.iov_len == base)
+        {
+            last.iov_len += len;
+            return;
+        }
+    }
+    m_iv[m_iv_count].iov_base = base;
+    m_iv[m_iv_count].iov_len = len;
+    ++m_iv_count;
+}
+
+// 发送队列引用了当前请求的文件，转交给m_files，整个队列发完后统一释放
+void http_conn::hold_file()
+{
+    m_files[m_file_count++] = m_file;
+    m_file = NULL;
+    m_file_address = 0;
+}
+
+// 文件从offset开始的len字节排入发送队列，大块用sendfile发送，不经过用户态内存；
+// io_uring模式仍由事件循环提交writev
+void http_conn::push_file(off_t offset, long len)
+{
+    if (m_epollfd >= 0 && len >= SENDFILE_THRESHOLD)
+    {
+        m_sendfile_fd = m_file->fd;
+        m_sendfile_offset = offset;
+        bytes_to_send += len;
+    }
+    else
+    {
+        push_iov(m_file_address + offset, len);
+    }
+}
+
+// 多范围响应每段占两个iovec(段首部和数据)，最后还有一个结束分隔行
+bool http_conn::can_queue_ranges()
+{
+    return m_iv_count + 2 * m_range_count + 1 <= 2 * MAX_PIPELINE &&
+           WRITE_BUFFER_SIZE - m_write_idx >= HEADER_RESERVE + m_range_count * (RANGE_PART_MAX + m_mime->header_len);
+}
+
+// 发送队列是否还能再容纳一个响应：iovec和文件引用有空位，写缓冲区够放一个响应头，
+// 且队列末尾不是sendfile发送的文件(sendfile之后的数据无法再用writev发出)
+bool http_conn::can_queue()
+{
+    return m_iv_count + 2 <= 2 * MAX_PIPELINE && m_file_count < MAX_PIPELINE &&
+           m_sendfile_fd < 0 && WRITE_BUFFER_SIZE - m_write_idx >= HEADER_RESERVE;
+}
+
+// 生成响应并排入发送队列，失败时发送队列恢复原样
+bool http_conn::queue_response(HTTP_CODE ret)
+{
+    int write_idx = m_write_idx;
+    int iv_count = m_iv_count;
+    int to_send = bytes_to_send;
+    size_t last_len = iv_count > 0 ? m_iv[iv_count - 1].iov_len : 0;
+    if (process_write(ret))
+        return true;
+
+    m_write_idx = write_idx;
+    m_iv_count = iv_count;
+    bytes_to_send = to_send;
+    if (iv_count > 0)
+        m_iv[iv_count - 1].iov_len = last_len;
+    m_sendfile_fd = -1;
+    release_file();
+    return false;
+}
+
+// 依次处理读缓冲区中所有完整的请求(HTTP/1.1流水线)，响应全部排入发送队列
+// 返回排入的响应数，0表示请求不完整，-1表示第一个请求就无法生成响应
+int http_conn::process_batch()
+{
+    int queued = 0;
+    while (true)
+    {
+        HTTP_CODE read_ret = process_read();
+        if (read_ret == NO_REQUEST)
+            break;
+        if (!queue_response(read_ret))
+        {
+            if (queued == 0)
+                return -1;
+            // 已排入的响应照常发出，之后关闭连接
+            m_keep_alive = false;
+            break;
+        }
+        ++queued;
+        m_keep_alive = m_linger;
+        next_request();
+        // 非keep-alive请求之后的数据不再处理；队列满时等发完再处理剩下的请求
+        if (!m_keep_alive || !can_queue())
+            break;
+    }
+    return queued;
+}
+
 // 由线程池中的工作线程调用，这是处理HTTP请求的入口函数
 void http_conn::process()
 {
-    // 解析HTTP请求
-    HTTP_CODE read_ret = process_read();
-    if (read_ret == NO_REQUEST) // 请求不完整
+    // io_uring模式下由事件循环提交I/O，处理结果通过完成队列交回
+    if (m_epollfd < 0)
+    {
+        m_completions->post(m_sockfd, m_generation, uring_batch());
+        return;
+    }
+    m_pipelined = false;
+    // 解析HTTP请求并生成响应
+    int queued = process_batch();
+    if (queued == 0) // 请求不完整
     {
         // 重新检测
         modfd(m_epollfd, m_sockfd, EPOLLIN, m_TRIGMode);
         return;
     }
-
-    // 生成响应
-    bool write_ret = process_write(read_ret);
-    if (!write_ret)
+    if (queued < 0)
     {
-        close_conn();
+        // 工作线程不直接关闭，交给事件循环关闭连接并删除定时器
+        notify_close();
+        return;
     }
     // 重新检测，重新注册EPOLLOUT事件
     modfd(m_epollfd, m_sockfd, EPOLLOUT, m_TRIGMode);
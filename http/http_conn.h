@@ -19,19 +19,34 @@
 #include <errno.h>
 #include <sys/wait.h>
 #include <sys/uio.h>
+#include <sys/sendfile.h>
 #include <map>
+#include <atomic>
 
 #include "../lock/locker.h"
+#include "../lock/completion_queue.h"
 #include "../CGImysql/sql_connection_pool.h"
 #include "../timer/lst_timer.h"
 #include "../log/log.h"
+#include "../cache/file_cache.h"
+#include "../buffer/buffer_pool.h"
+#include "../buffer/arena.h"
+#include "http_scan.h"
+#include "http_router.h"
 
 class http_conn
 {
 public:
     static const int FILENAME_LEN = 200;
-    static const int READ_BUFFER_SIZE = 2048;  // 读缓冲区大小
-    static const int WRITE_BUFFER_SIZE = 1024; // 写缓冲区大小
+    static const int READ_BUFFER_SIZE = 2048;  // 读缓冲区初始大小，请求较大时按缓冲区池的级别翻倍增长
+    static const int WRITE_BUFFER_SIZE = 4096; // 写缓冲区大小，流水线的多个响应头依次存放
+    static const int HEADER_RESERVE = 512;     // 排入一个响应前写缓冲区至少要剩下的空间
+    static const int SENDFILE_THRESHOLD = 16 * 1024; // 不小于该大小的文件通过sendfile发送
+    static const int MAX_PIPELINE = 16;              // 流水线请求一次最多排入发送队列的响应数
+    static const int MAX_HEADERS = 32;               // 每个请求最多记录的首部数，超出的首部被忽略
+    static const int SPLICE_CHUNK = 64 * 1024;       // 上传时每次从socket splice到管道的最大字节数
+    static const int MAX_RANGES = 8;                 // Range请求最多的范围数，超出时发送整个文件
+    static const int RANGE_PART_MAX = 128;           // 多范围响应中每一段的分隔行和段首部(不含Content-Type)的最大长度
     // HTTP请求方法
     enum METHOD
     {
@@ -54,6 +69,11 @@ public:
         NO_RESOURCE,       // 表示服务器没有资源
         FORBIDDEN_REQUEST, // 表示客户对资源没有足够的访问权限
         FILE_REQUEST,      // 文件请求，获取文件成功
+        UPLOAD_REQUEST,    // 上传请求，请求体已全部写入文件
+        NOT_MODIFIED,      // 条件请求，客户端缓存的文件仍然有效
+        PARTIAL_CONTENT,   // Range请求，发送文件的一个或多个范围
+        RANGE_NOT_SATISFIABLE, // Range请求的范围全部超出文件大小
+        LENGTH_REQUIRED,   // 上传请求没有Content-Length
         INTERNAL_ERROR,    // 表示服务器内部错误
         CLOSED_CONNECTION  // 表示客户端已经关闭连接了
     };
@@ -71,13 +91,34 @@ public:
         LINE_BAD,    // 行出错
         LINE_OPEN    // 行数据尚且不完整
     };
+    // io_uring模式下，连接处理完一次完成事件后需要事件循环提交的下一个I/O
+    enum URING_NEXT
+    {
+        URING_RECV = 0, // 继续接收请求
+        URING_SEND,     // 发送响应
+        URING_CLOSE,    // 关闭连接
+        URING_WORKER    // 请求可能阻塞，交给工作线程处理
+    };
+
+    // 一个请求首部在读缓冲区中的位置，不复制数据
+    // 解析时首部名末尾的':'和首部值末尾的空白被替换为'\0'，两者都可以直接当作C字符串使用
+    struct header_field
+    {
+        int name;      // 首部名在m_read_buf中的偏移
+        int name_len;
+        int value;     // 首部值(已去掉前后空白)在m_read_buf中的偏移
+        int value_len;
+    };
 
 public:
-    http_conn() {}
-    ~http_conn() {}
+    http_conn() : m_inflight(NULL), m_read_buf(NULL), m_read_size(0), m_body_fd(-1), m_file_count(0), m_file(NULL), m_file_address(NULL)
+    {
+        m_pipe[0] = m_pipe[1] = -1;
+    }
+    ~http_conn();
 
 public:
-    void init(int sockfd, const sockaddr_in &addr, char *, int, int, string user, string passwd, string sqlname); // 初始化连接
+    void init(int sockfd, const sockaddr_in &addr, char *, int, int, int epollfd, completion_queue *completions); // 初始化连接
     void close_conn(bool real_close = true);                                                                      // 关闭连接
     void process();                                                                                               // 处理客户端请求
     bool read_once();                                                                                             // 非阻塞读
@@ -86,70 +127,178 @@ public:
     {
         return &m_address;
     }
-    void initmysql_result(connection_pool *connPool); // 初始化数据库连接
-    int timer_flag;
-    int improv;
+    static void initmysql_result(connection_pool *connPool, int close_log); // 初始化数据库连接
+    void notify_close();                              // 工作线程通知所属事件循环关闭该连接
+    unsigned generation() const { return m_generation; }
+    // 线程池分派任务时pin()，工作线程处理完后unpin()，之后不能再访问该连接；连接表据此判断slab能否释放
+    void set_inflight(std::atomic<int> *inflight) { m_inflight = inflight; }
+    void pin()
+    {
+        if (m_inflight)
+            m_inflight->fetch_add(1, std::memory_order_relaxed);
+    }
+    void unpin()
+    {
+        if (m_inflight)
+            m_inflight->fetch_sub(1, std::memory_order_release);
+    }
+    bool pipelined()                                  // write()发送完后读缓冲区中还有流水线请求，需要再次process()
+    {
+        return m_pipelined;
+    }
+    const char *get_header(HTTP_HEADER id, int *len = NULL);    // 常用首部的值，请求中没有时返回NULL
+    const char *find_header(const char *name, int *len = NULL); // 按名字(不区分大小写)查找任意首部
+
+    // io_uring模式：I/O由事件循环以SQE的形式提交，连接只负责缓冲区和状态机
+    char *recv_buf(int &len);                  // 本次recv的目标位置和可用空间，缓冲区满返回NULL
+    URING_NEXT recv_done(int bytes);           // recv完成，解析请求并生成响应，可能阻塞时返回URING_WORKER
+    struct iovec *send_iov(int &count);        // 待发送的数据
+    URING_NEXT send_done(int bytes);           // writev完成
 
 private:
-    void init();              // 初始化
-    HTTP_CODE process_read(); // 读数据
+    typedef HTTP_CODE (http_conn::*route_handler)();
+    static const route_handler route_handlers[ROUTE_COUNT]; // 各ROUTE_ACTION的处理函数
+
+    void init();                                            // 初始化
+    void reset_request();                                   // 重置请求解析状态
+    void reset_response();                                  // 清空发送队列
+    void next_request();                                    // 丢弃已处理的请求，剩余的流水线数据移到读缓冲区头部
+    int process_batch();                                    // 处理读缓冲区中所有完整的请求
+    bool can_queue();                                       // 发送队列是否还能容纳一个响应
+    bool queue_response(HTTP_CODE ret);                     // 生成响应并排入发送队列，失败时回滚
+    HTTP_CODE process_read();                               // 读数据
     bool process_write(HTTP_CODE ret);
     HTTP_CODE parse_request_line(char *text);               // 解析请求首行
     HTTP_CODE parse_headers(char *text);                    // 解析请求头
     HTTP_CODE parse_content(char *text);                    // 解析请求体
-    HTTP_CODE do_request();                                 // 处理请求
+    HTTP_CODE parse_upload();                               // 上传请求：把已读到的请求体交给on_body()，收齐后完成上传
+    HTTP_CODE begin_upload();                               // 打开上传的临时文件
+    bool on_body(const char *data, int len);                // 处理一段请求体，写入临时文件
+    HTTP_CODE finish_upload();                              // 请求体收齐，临时文件改名为目标文件
+    void abort_upload();                                    // 放弃未完成的上传，删除临时文件
+    bool splice_body();                                     // 剩余的请求体经管道从socket直接splice到文件
+    HTTP_CODE do_request();                                 // 处理请求，按路由分派到下列处理函数
+    HTTP_CODE serve_static();                               // 发送与url同名的静态文件
+    HTTP_CODE serve_page();                                 // 发送路由指定的页面
+    HTTP_CODE check_login();                                // 登录检测
+    HTTP_CODE check_register();                             // 注册检测
+    HTTP_CODE serve_file(const char *path);                 // 发送资源目录下的文件
+    bool parse_credentials(char *&name, char *&password);  // 从请求体中取出用户名和密码
+    void negotiate_encoding();                              // 客户端接受时改用同名的预压缩文件
+    bool not_modified();                                    // If-None-Match或If-Modified-Since与文件一致
+    int parse_range();                                      // 解析Range首部，返回可满足的范围数
+    bool range_applies();                                   // If-Range与文件一致，Range有效
     char *get_line() { return m_read_buf + m_start_line; }; // 内联函数，获取一行数据
     LINE_STATUS parse_line();                               // 获取一行数据，交给主状态机处理
-    void unmap();
-    bool add_response(const char *format, ...);
-    bool add_content(const char *content);
-    bool add_status_line(int status, const char *title);
-    bool add_headers(int content_length);
-    bool add_content_type();
-    bool add_content_length(int content_length);
+    URING_NEXT uring_batch();                               // io_uring模式下解析读缓冲区中的请求
+    bool may_block();                                       // 读缓冲区中的请求是否可能阻塞事件循环
+    void unmap();                                           // 释放对缓存文件的引用
+    void release_file();                                    // 释放当前请求的文件，不影响发送队列中的文件
+    void update_iov(int bytes);                             // 已发送bytes字节后调整发送队列
+    void push_iov(char *base, int len);                     // 追加一段待发送数据
+    void hold_file();                                       // 当前请求的文件转入发送队列，发送完后释放
+    void push_file(off_t offset, long len);                 // 文件的一段排入发送队列
+    bool can_queue_ranges();                                // 发送队列能否容纳多范围响应
+    bool reserve_read();                                    // 保证读缓冲区还有空间，满了就换一块更大的
+    void release_read_buf();                                // 连接空闲时把读缓冲区还给缓冲区池
+    void add_header(HTTP_HEADER id, char *name, int name_len, char *value, int value_len); // 记录解析到的首部
+    bool add_response(const char *data, int len);            // 原样追加一段数据到写缓冲区
+    bool add_number(unsigned long value);                    // 追加十进制整数
+    bool add_content(const char *content, int len);
+    bool add_status_line(const char *line, int len);         // 状态行和Date首部
+    bool add_date();
+    bool add_content_encoding();
+    bool add_vary();
+    bool add_validators();                                   // Last-Modified和ETag
+    bool add_accept_ranges();
+    bool add_content_range(off_t first, off_t last);
+    bool add_headers(long content_length);
+    bool add_content_type(const mime_type *type);
+    bool add_content_length(long content_length);
     bool add_linger();
     bool add_blank_line();
 
 public:
-    static int m_epollfd;    // epoll文件描述符，设置为static，全局可见，所有的socket上的事件都被注册到同一个epoll对象中
-    static int m_user_count; // 统计用户数量
-    MYSQL *mysql;
-    int m_state; // 读为0, 写为1
+    // 静态成员上的alignas只对齐起始地址，后面仍可能紧跟其他全局变量，用独占一个缓存行的类型
+    struct alignas(64) shared_count : std::atomic<int>
+    {
+        shared_count(int n) : std::atomic<int>(n) {}
+    };
+    // 多个事件循环线程在接受和关闭连接时并发增减
+    static shared_count m_user_count;
+
+    // 以下一组由事件循环在建立连接和分派任务时写入，工作线程处理请求期间事件循环仍会读取代数和fd，
+    // 独占对象开头的缓存行，不和工作线程频繁写的解析、发送状态共用
+    alignas(64) int m_state; // 读为0, 写为1
 
 private:
     int m_sockfd;                        // 该http连接的socket
-    sockaddr_in m_address;               // 通信的socket地址
-    char m_read_buf[READ_BUFFER_SIZE];   // 读缓冲区
+    int m_epollfd;                       // 所属事件循环的epoll文件描述符
+    int m_TRIGMode;
+    unsigned m_generation;               // 连接的代数，每次init时取新值，用于丢弃fd复用前的过期通知
+    completion_queue *m_completions;     // 所属事件循环的完成队列
+    std::atomic<int> *m_inflight;        // 所在slab的在途任务计数，不经过线程池时为NULL
+
+    // 以下是工作线程每个请求都要读写的热数据，按访问顺序集中在相邻的几个缓存行
+    // 请求解析状态
+    alignas(64) char *m_read_buf;        // 读缓冲区，从缓冲区池取得，空闲时为NULL
     long m_read_idx;                     // 标识读缓冲区中已经读入的客户端数据的最后一个字节的下一个位置
     long m_checked_idx;                  // 当前正在分析的字符在读缓冲区的位置
+    int m_read_size;                     // 读缓冲区可用大小，末尾另外保留一个字节给'\0'
     int m_start_line;                    // 当前正在解析的行的起始位置
-    char m_write_buf[WRITE_BUFFER_SIZE]; // 写缓冲区
-    int m_write_idx;                     // 写缓冲区待发送字节数
     CHECK_STATE m_check_state;           // 主状态机的当前状态
-    char m_real_file[FILENAME_LEN];      // 存储完整的资源路径
     METHOD m_method;                     // HTTP请求方法
     char *m_url;                         // 请求目标文件的文件名
     char *m_version;                     // HTTP协议版本
     char *m_host;                        // 主机名：ip地址及端口号
     long m_content_length;               // 请求体长度
+    long m_body_remain;                  // 上传请求还未收到的请求体字节数
+    int m_body_fd;                       // 上传的临时文件，没有进行中的上传时为-1
+    int m_header_count;
+    signed char m_known[HEADER_COUNT];   // 常用首部在m_headers中的下标，没有时为-1
     bool m_linger;                       // 判断是否保持连接keep alive，长连接或短链接
-    char *m_file_address;                // 读取服务器上的文件地址
-    struct stat m_file_stat;
-    struct iovec m_iv[2];
+    bool m_upload;                       // 是否为上传请求(PUT或POST /upload/文件名)，请求体以流的方式写入文件
+    bool m_keep_alive;                   // 发送队列中最后一个响应是否保持连接，决定发送完后是否关闭
+    bool m_pipelined;                    // 发送完后读缓冲区中还有未处理的数据
+    char m_body_end;                     // 请求体结束处被'\0'覆盖的字节，属于下一个流水线请求
+    const route *m_route;                // 请求行解析时查到的路由，没有时为NULL
+    int m_encoding;                      // 响应使用的预压缩格式(CONTENT_ENCODING)，0为原文件
+    bool m_vary;                         // 文件有预压缩版本，响应随Accept-Encoding变化
+    const mime_type *m_mime;             // 请求的文件的类型，发送预压缩文件时仍为原文件的类型
+    int cgi;                             // 是否启用的POST
+    char *m_string;                      // 存储请求头数据
+
+    // 发送状态
+    int m_write_idx;                     // 写缓冲区已写入字节数，流水线的多个响应头依次存放
     int m_iv_count;
-    int cgi;             // 是否启用的POST
-    char *m_string;      // 存储请求头数据
-    int bytes_to_send;   // 剩余发送字节数
-    int bytes_have_send; // 已发送字节数
-    char *doc_root;
+    int m_iv_idx;                        // 第一段未发完的数据
+    int bytes_to_send;                   // 剩余发送字节数
+    int bytes_have_send;                 // 已发送字节数
+    int m_sendfile_fd;                   // 发送队列末尾通过sendfile发送的文件，没有时为-1
+    int m_file_count;
+    off_t m_sendfile_offset;             // sendfile的当前偏移量
+    file_entry *m_file;                  // 从文件缓存中取得的文件，发送完后释放引用
+    char *m_file_address;                // 读取服务器上的文件地址
 
-    map<string, string> m_users;
-    int m_TRIGMode;
-    int m_close_log;
+    // 按下标访问的数组，每个请求只用到开头的几项
+    struct iovec m_iv[2 * MAX_PIPELINE]; // 发送队列，每个响应最多占两段
+    file_entry *m_files[MAX_PIPELINE];   // 发送队列引用的缓存文件
+    header_field m_headers[MAX_HEADERS]; // 当前请求的全部首部，按出现顺序
+    char m_write_buf[WRITE_BUFFER_SIZE]; // 写缓冲区
 
-    char sql_user[100];
-    char sql_passwd[100];
-    char sql_name[100];
+    // 以下是建立连接时设置或只有少数请求用到的冷数据
+    sockaddr_in m_address;               // 通信的socket地址
+    static std::atomic<unsigned> m_next_generation; // 各事件循环共用的代数计数
+    char *doc_root;
+    int m_close_log;
+    int m_pipe[2];                       // splice上传数据用的管道，上传结束后关闭
+    struct stat m_file_stat;
+    char m_real_file[FILENAME_LEN];      // 存储完整的资源路径
+    char m_upload_tmp[FILENAME_LEN];     // 上传的临时文件路径，收齐后改名为m_real_file
+    arena m_arena;                       // 本次请求的临时内存，开始处理下一个请求时回收
+    off_t m_range_first[MAX_RANGES];     // Range请求各范围的首尾字节，包含两端
+    off_t m_range_last[MAX_RANGES];
+    int m_range_count;
 };
 
 #endif
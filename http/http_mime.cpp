@@ -0,0 +1,142 @@
+#include "http_mime.h"
+
+#include <string.h>
+
+#define CONTENT_TYPE(t) "Content-Type: " t "\r\n"
+#define MIME(ext, t) mime_type(ext, CONTENT_TYPE(t))
+
+// 按扩展名的字典序排列，新增类型时插入到对应位置
+static constexpr mime_type mime_types[] = {
+    MIME("7z", "application/x-7z-compressed"),
+    MIME("aac", "audio/aac"),
+    MIME("avi", "video/x-msvideo"),
+    MIME("avif", "image/avif"),
+    MIME("bmp", "image/bmp"),
+    MIME("br", "application/x-brotli"),
+    MIME("bz2", "application/x-bzip2"),
+    MIME("css", "text/css; charset=utf-8"),
+    MIME("csv", "text/csv; charset=utf-8"),
+    MIME("doc", "application/msword"),
+    MIME("docx", "application/vnd.openxmlformats-officedocument.wordprocessingml.document"),
+    MIME("eot", "application/vnd.ms-fontobject"),
+    MIME("epub", "application/epub+zip"),
+    MIME("flac", "audio/flac"),
+    MIME("gif", "image/gif"),
+    MIME("gz", "application/gzip"),
+    MIME("htm", "text/html; charset=utf-8"),
+    MIME("html", "text/html; charset=utf-8"),
+    MIME("ico", "image/x-icon"),
+    MIME("jpeg", "image/jpeg"),
+    MIME("jpg", "image/jpeg"),
+    MIME("js", "text/javascript; charset=utf-8"),
+    MIME("json", "application/json"),
+    MIME("m4a", "audio/mp4"),
+    MIME("map", "application/json"),
+    MIME("md", "text/markdown; charset=utf-8"),
+    MIME("mjs", "text/javascript; charset=utf-8"),
+    MIME("mkv", "video/x-matroska"),
+    MIME("mov", "video/quicktime"),
+    MIME("mp3", "audio/mpeg"),
+    MIME("mp4", "video/mp4"),
+    MIME("mpeg", "video/mpeg"),
+    MIME("oga", "audio/ogg"),
+    MIME("ogg", "audio/ogg"),
+    MIME("ogv", "video/ogg"),
+    MIME("otf", "font/otf"),
+    MIME("pdf", "application/pdf"),
+    MIME("png", "image/png"),
+    MIME("ppt", "application/vnd.ms-powerpoint"),
+    MIME("pptx", "application/vnd.openxmlformats-officedocument.presentationml.presentation"),
+    MIME("rar", "application/vnd.rar"),
+    MIME("rtf", "application/rtf"),
+    MIME("svg", "image/svg+xml"),
+    MIME("tar", "application/x-tar"),
+    MIME("tif", "image/tiff"),
+    MIME("tiff", "image/tiff"),
+    MIME("ts", "video/mp2t"),
+    MIME("ttf", "font/ttf"),
+    MIME("txt", "text/plain; charset=utf-8"),
+    MIME("wasm", "application/wasm"),
+    MIME("wav", "audio/wav"),
+    MIME("weba", "audio/webm"),
+    MIME("webm", "video/webm"),
+    MIME("webmanifest", "application/manifest+json"),
+    MIME("webp", "image/webp"),
+    MIME("woff", "font/woff"),
+    MIME("woff2", "font/woff2"),
+    MIME("xhtml", "application/xhtml+xml"),
+    MIME("xls", "application/vnd.ms-excel"),
+    MIME("xlsx", "application/vnd.openxmlformats-officedocument.spreadsheetml.sheet"),
+    MIME("xml", "application/xml"),
+    MIME("zip", "application/zip"),
+};
+
+static const int MIME_TYPE_NUM = sizeof(mime_types) / sizeof(mime_types[0]);
+static const int EXT_LEN_MAX = 16; // 比表中最长的扩展名长，更长的扩展名不可能匹配
+
+static constexpr int ext_compare(const char *a, const char *b)
+{
+    while (*a && *a == *b)
+    {
+        ++a;
+        ++b;
+    }
+    return (unsigned char)*a - (unsigned char)*b;
+}
+
+static constexpr bool mime_types_sorted()
+{
+    for (int i = 1; i < MIME_TYPE_NUM; ++i)
+        if (ext_compare(mime_types[i - 1].ext, mime_types[i].ext) >= 0)
+            return false;
+    return true;
+}
+
+static constexpr bool mime_exts_fit()
+{
+    for (int i = 0; i < MIME_TYPE_NUM; ++i)
+        if (mime_type::length(mime_types[i].ext) >= EXT_LEN_MAX)
+            return false;
+    return true;
+}
+
+static_assert(mime_types_sorted(), "mime_types must be sorted by extension without duplicates");
+static_assert(mime_exts_fit(), "extension in mime_types longer than EXT_LEN_MAX");
+
+static constexpr mime_type mime_octet_stream("", CONTENT_TYPE("application/octet-stream"));
+constexpr mime_type mime_text_html("html", CONTENT_TYPE("text/html; charset=utf-8"));
+constexpr mime_type mime_text_plain("txt", CONTENT_TYPE("text/plain; charset=utf-8"));
+
+const mime_type *http_mime_type(const char *path)
+{
+    // 扩展名从最后一个路径分量中最后一个'.'开始，以'.'开头的文件名没有扩展名
+    const char *name = strrchr(path, '/');
+    name = name ? name + 1 : path;
+    const char *dot = strrchr(name, '.');
+    if (!dot || dot == name)
+        return &mime_octet_stream;
+
+    char ext[EXT_LEN_MAX];
+    int len = 0;
+    for (const char *p = dot + 1; *p; ++p)
+    {
+        if (len == EXT_LEN_MAX - 1)
+            return &mime_octet_stream;
+        ext[len++] = (*p >= 'A' && *p <= 'Z') ? *p - 'A' + 'a' : *p;
+    }
+    ext[len] = '\0';
+
+    int low = 0, high = MIME_TYPE_NUM - 1;
+    while (low <= high)
+    {
+        int mid = (low + high) / 2;
+        int cmp = ext_compare(ext, mime_types[mid].ext);
+        if (cmp == 0)
+            return &mime_types[mid];
+        if (cmp < 0)
+            high = mid - 1;
+        else
+            low = mid + 1;
+    }
+    return &mime_octet_stream;
+}
@@ -0,0 +1,34 @@
+#ifndef HTTP_MIME_H
+#define HTTP_MIME_H
+
+/*
+扩展名到MIME类型的映射
+    编译期按扩展名排好序的常量表，有序性由static_assert检查，查找为二分查找
+    文件载入缓存时查一次，结果随缓存项保存，发送响应时直接复制整行Content-Type
+*/
+
+struct mime_type
+{
+    const char *ext;    // 小写扩展名，不含'.'
+    const char *header; // 完整的响应头行"Content-Type: ...\r\n"
+    int header_len;
+
+    constexpr mime_type(const char *e, const char *h) : ext(e), header(h), header_len(length(h)) {}
+
+    static constexpr int length(const char *s)
+    {
+        int n = 0;
+        while (s[n])
+            ++n;
+        return n;
+    }
+};
+
+// path的扩展名(不区分大小写)对应的类型，没有扩展名或扩展名未知时为application/octet-stream
+const mime_type *http_mime_type(const char *path);
+
+// 服务器自己生成的响应体(错误提示等)使用的类型
+extern const mime_type mime_text_html;
+extern const mime_type mime_text_plain;
+
+#endif
@@ -0,0 +1,190 @@
+#include "http_router.h"
+
+#include <string.h>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+// 精确路径，页面的url与html中表单的action对应(见resources/README.md)
+static constexpr route exact_routes[] = {
+    route("/", ROUTE_PAGE, "/judge.html"),
+    route("/0", ROUTE_PAGE, "/register.html"),
+    route("/1", ROUTE_PAGE, "/log.html"),
+    route("/2CGISQL.cgi", ROUTE_LOGIN),
+    route("/3CGISQL.cgi", ROUTE_REGISTER),
+    route("/5", ROUTE_PAGE, "/picture.html"),
+    route("/6", ROUTE_PAGE, "/video.html"),
+    route("/7", ROUTE_PAGE, "/other.html"),
+    route("/9", ROUTE_PAGE, "/mytest.html"),
+};
+
+// 前缀路径
+static const route prefix_routes[] = {
+    route("/upload/", ROUTE_UPLOAD),
+};
+
+static const int EXACT_ROUTE_NUM = sizeof(exact_routes) / sizeof(exact_routes[0]);
+static const int ROUTE_TABLE_SIZE = 64; // 哈希表大小，2的幂，路由数的几倍以便容易找到无冲突的种子
+
+// FNV-1a，种子参与初始值，编译期为路由表找一个没有冲突的种子
+static constexpr unsigned route_hash(const char *s, int len, unsigned seed)
+{
+    unsigned h = 2166136261u ^ seed;
+    for (int i = 0; i < len; ++i)
+    {
+        h ^= (unsigned char)s[i];
+        h *= 16777619u;
+    }
+    return h & (ROUTE_TABLE_SIZE - 1);
+}
+
+struct route_table
+{
+    unsigned seed;                     // 没有找到无冲突的种子时为~0u
+    signed char slots[ROUTE_TABLE_SIZE]; // exact_routes中的下标，空位为-1
+};
+
+static constexpr route_table make_route_table()
+{
+    route_table table{};
+    for (unsigned seed = 0; seed < 1024; ++seed)
+    {
+        for (int i = 0; i < ROUTE_TABLE_SIZE; ++i)
+            table.slots[i] = -1;
+        bool collided = false;
+        for (int i = 0; i < EXACT_ROUTE_NUM && !collided; ++i)
+        {
+            unsigned h = route_hash(exact_routes[i].path, exact_routes[i].len, seed);
+            if (table.slots[h] >= 0)
+                collided = true;
+            else
+                table.slots[h] = i;
+        }
+        if (!collided)
+        {
+            table.seed = seed;
+            return table;
+        }
+    }
+    table.seed = ~0u;
+    return table;
+}
+
+static constexpr route_table exact_table = make_route_table();
+static_assert(exact_table.seed != ~0u, "no collision-free seed for exact_routes, enlarge ROUTE_TABLE_SIZE");
+
+/*
+前缀路由的基数树
+    每条边是路径的一段，同一节点的子节点首字符互不相同，沿url逐段向下，记下最后一个有路由的节点
+    启动时由prefix_routes建成，之后只读
+*/
+class radix_tree
+{
+public:
+    radix_tree()
+    {
+        m_root.value = NULL;
+        for (size_t i = 0; i < sizeof(prefix_routes) / sizeof(prefix_routes[0]); ++i)
+            insert(&prefix_routes[i]);
+    }
+    ~radix_tree()
+    {
+        destroy(&m_root);
+    }
+
+    const route *longest_match(const char *url, int len) const
+    {
+        const node *n = &m_root;
+        const route *best = n->value;
+        int pos = 0;
+        while (pos < len)
+        {
+            const node *child = find_child(n, url[pos]);
+            if (!child || len - pos < (int)child->label.size() ||
+                memcmp(url + pos, child->label.data(), child->label.size()) != 0)
+                break;
+            pos += child->label.size();
+            n = child;
+            if (n->value)
+                best = n->value;
+        }
+        return best;
+    }
+
+private:
+    struct node
+    {
+        string label;           // 从父节点到这里的一段路径
+        const route *value;     // 到这里为止的前缀对应的路由，没有时为NULL
+        vector<node *> children;
+    };
+
+    static node *find_child(const node *n, char c)
+    {
+        for (size_t i = 0; i < n->children.size(); ++i)
+            if (n->children[i]->label[0] == c)
+                return n->children[i];
+        return NULL;
+    }
+
+    // 与已有的边只有部分相同时，把该边从分叉处拆成两段
+    void insert(const route *r)
+    {
+        node *n = &m_root;
+        int pos = 0;
+        while (pos < r->len)
+        {
+            node *child = find_child(n, r->path[pos]);
+            if (!child)
+            {
+                child = new node;
+                child->label.assign(r->path + pos, r->len - pos);
+                child->value = r;
+                n->children.push_back(child);
+                return;
+            }
+            size_t common = 0;
+            while (common < child->label.size() && pos + (int)common < r->len &&
+                   child->label[common] == r->path[pos + common])
+                ++common;
+            if (common < child->label.size())
+            {
+                node *mid = new node;
+                mid->label = child->label.substr(0, common);
+                mid->value = NULL;
+                mid->children.push_back(child);
+                child->label.erase(0, common);
+                for (size_t i = 0; i < n->children.size(); ++i)
+                    if (n->children[i] == child)
+                        n->children[i] = mid;
+                child = mid;
+            }
+            n = child;
+            pos += common;
+        }
+        n->value = r;
+    }
+
+    static void destroy(node *n)
+    {
+        for (size_t i = 0; i < n->children.size(); ++i)
+        {
+            destroy(n->children[i]);
+            delete n->children[i];
+        }
+    }
+
+private:
+    node m_root;
+};
+
+static const radix_tree prefix_tree;
+
+const route *http_route(const char *url, int len)
+{
+    int i = exact_table.slots[route_hash(url, len, exact_table.seed)];
+    if (i >= 0 && exact_routes[i].len == len && memcmp(exact_routes[i].path, url, len) == 0)
+        return &exact_routes[i];
+    return prefix_tree.longest_match(url, len);
+}
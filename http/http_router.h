@@ -0,0 +1,44 @@
+#ifndef HTTP_ROUTER_H
+#define HTTP_ROUTER_H
+
+/*
+请求路由
+    精确路径放在编译期生成的完美哈希表中，一次哈希、一次比较即可确定，表是否无冲突由static_assert检查
+    前缀路径(如/upload/)放在基数树中按最长前缀匹配
+    路由表只含常量，查找不分配内存；新增接口只需在http_router.cpp的路由表中加一行
+*/
+
+// 路由对应的处理方式，由http_conn分派到对应的处理函数
+enum ROUTE_ACTION
+{
+    ROUTE_STATIC = 0, // 没有匹配的路由，按url发送静态文件
+    ROUTE_PAGE,       // 固定页面，发送route::target指定的文件
+    ROUTE_LOGIN,      // 登录检测，POST请求体中为用户名和密码
+    ROUTE_REGISTER,   // 注册检测
+    ROUTE_UPLOAD,     // 上传，url中前缀之后为文件名
+    ROUTE_COUNT
+};
+
+struct route
+{
+    const char *path;    // 精确路径或前缀
+    int len;
+    ROUTE_ACTION action;
+    const char *target;  // ROUTE_PAGE要发送的文件，相对于资源目录
+
+    constexpr route(const char *p, ROUTE_ACTION a, const char *t = nullptr)
+        : path(p), len(length(p)), action(a), target(t) {}
+
+    static constexpr int length(const char *s)
+    {
+        int n = 0;
+        while (s[n])
+            ++n;
+        return n;
+    }
+};
+
+// 查找url(长度为len，不要求以'\0'结尾)对应的路由，精确路径优先，其次最长前缀，都没有时返回NULL
+const route *http_route(const char *url, int len);
+
+#endif
@@ -0,0 +1,147 @@
+#include "http_scan.h"
+
+#include <stddef.h>
+#include <string.h>
+#include <strings.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+typedef const char *(*scan_func)(const char *begin, const char *end, char a, char b);
+
+// 逐字节查找，也用于处理SIMD实现剩下不足一个向量的尾部
+static const char *scan_scalar(const char *p, const char *end, char a, char b)
+{
+    for (; p < end; ++p)
+        if (*p == a || *p == b)
+            return p;
+    return end;
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+// 每次加载32字节，分别与a、b逐字节比较，匹配位置的掩码取最低位
+__attribute__((target("avx2"))) static const char *scan_avx2(const char *p, const char *end, char a, char b)
+{
+    __m256i va = _mm256_set1_epi8(a);
+    __m256i vb = _mm256_set1_epi8(b);
+    for (; end - p >= 32; p += 32)
+    {
+        __m256i v = _mm256_loadu_si256((const __m256i *)p);
+        unsigned mask = _mm256_movemask_epi8(_mm256_or_si256(_mm256_cmpeq_epi8(v, va), _mm256_cmpeq_epi8(v, vb)));
+        if (mask)
+            return p + __builtin_ctz(mask);
+    }
+    return scan_scalar(p, end, a, b);
+}
+
+// pcmpestri以{a, b}为字符集，返回16字节中第一个属于该字符集的字节下标，没有时返回16
+__attribute__((target("sse4.2"))) static const char *scan_sse42(const char *p, const char *end, char a, char b)
+{
+    __m128i set = _mm_setr_epi8(a, b, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0);
+    for (; end - p >= 16; p += 16)
+    {
+        __m128i v = _mm_loadu_si128((const __m128i *)p);
+        int idx = _mm_cmpestri(set, 2, v, 16, _SIDD_UBYTE_OPS | _SIDD_CMP_EQUAL_ANY | _SIDD_LEAST_SIGNIFICANT);
+        if (idx < 16)
+            return p + idx;
+    }
+    return scan_scalar(p, end, a, b);
+}
+#endif
+
+static scan_func select_scan(const char *&name)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+    {
+        name = "avx2";
+        return scan_avx2;
+    }
+    if (__builtin_cpu_supports("sse4.2"))
+    {
+        name = "sse4.2";
+        return scan_sse42;
+    }
+#endif
+    name = "scalar";
+    return scan_scalar;
+}
+
+// 程序启动时根据cpuid选定，之后只读
+static const char *scan_name;
+static const scan_func scan = select_scan(scan_name);
+
+const char *http_scan(const char *begin, const char *end, char a, char b)
+{
+    return scan(begin, end, a, b);
+}
+
+const char *http_scan_impl()
+{
+    return scan_name;
+}
+
+struct header_entry
+{
+    const char *name;
+    int len;
+    HTTP_HEADER id;
+};
+
+static constexpr header_entry known_headers[] = {
+    {"Host", 4, HEADER_HOST},
+    {"Connection", 10, HEADER_CONNECTION},
+    {"Content-Length", 14, HEADER_CONTENT_LENGTH},
+    {"Content-Type", 12, HEADER_CONTENT_TYPE},
+    {"Accept", 6, HEADER_ACCEPT},
+    {"Accept-Encoding", 15, HEADER_ACCEPT_ENCODING},
+    {"Cookie", 6, HEADER_COOKIE},
+    {"If-Modified-Since", 17, HEADER_IF_MODIFIED_SINCE},
+    {"If-None-Match", 13, HEADER_IF_NONE_MATCH},
+    {"If-Range", 8, HEADER_IF_RANGE},
+    {"Range", 5, HEADER_RANGE},
+    {"Referer", 7, HEADER_REFERER},
+    {"User-Agent", 10, HEADER_USER_AGENT},
+};
+
+static const int HEADER_TABLE_SIZE = 32;
+
+// 哈希值为(长度*7 + 首字母 + 尾字母) & 31，字母统一按小写计算
+// 对known_headers中的首部名两两不同，新增首部时需保证不冲突(编译期由static_assert检查)
+static constexpr unsigned header_hash(const char *name, int len)
+{
+    return (len * 7 + (name[0] | 0x20) + (name[len - 1] | 0x20)) & (HEADER_TABLE_SIZE - 1);
+}
+
+struct header_table
+{
+    header_entry slots[HEADER_TABLE_SIZE];
+    bool collided; // 有两个首部落在同一个槽位
+};
+
+static constexpr header_table make_header_table()
+{
+    header_table table{};
+    for (const header_entry &entry : known_headers)
+    {
+        unsigned h = header_hash(entry.name, entry.len);
+        if (table.slots[h].name)
+            table.collided = true;
+        table.slots[h] = entry;
+    }
+    return table;
+}
+
+static constexpr header_table headers = make_header_table();
+static_assert(!headers.collided, "header_hash collides on known_headers, adjust the hash");
+
+HTTP_HEADER http_header_lookup(const char *name, int len)
+{
+    if (len <= 0)
+        return HEADER_UNKNOWN;
+    const header_entry &entry = headers.slots[header_hash(name, len)];
+    if (entry.len == len && strncasecmp(entry.name, name, len) == 0)
+        return entry.id;
+    return HEADER_UNKNOWN;
+}
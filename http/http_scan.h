@@ -0,0 +1,40 @@
+#ifndef HTTP_SCAN_H
+#define HTTP_SCAN_H
+
+/*
+请求报文扫描
+    查找行结束符和首部的':'分隔符，CPU支持时用AVX2一次比较32字节，或用SSE4.2的pcmpestri一次比较16字节，
+    都不支持时逐字节查找，具体实现在程序启动时通过cpuid选定
+    首部名通过完美哈希分派，一次比较即可确定是哪个首部
+*/
+
+// 常用的请求首部，解析时记录位置，可按枚举值O(1)取得
+enum HTTP_HEADER
+{
+    HEADER_UNKNOWN = 0,        // 不在下列之中的首部
+    HEADER_HOST,               // Host
+    HEADER_CONNECTION,         // Connection
+    HEADER_CONTENT_LENGTH,     // Content-Length
+    HEADER_CONTENT_TYPE,       // Content-Type
+    HEADER_ACCEPT,             // Accept
+    HEADER_ACCEPT_ENCODING,    // Accept-Encoding
+    HEADER_COOKIE,             // Cookie
+    HEADER_IF_MODIFIED_SINCE,  // If-Modified-Since
+    HEADER_IF_NONE_MATCH,      // If-None-Match
+    HEADER_IF_RANGE,           // If-Range
+    HEADER_RANGE,              // Range
+    HEADER_REFERER,            // Referer
+    HEADER_USER_AGENT,         // User-Agent
+    HEADER_COUNT
+};
+
+// 在[begin, end)中查找第一个等于a或b的字节，没有时返回end
+const char *http_scan(const char *begin, const char *end, char a, char b);
+
+// 当前使用的扫描实现："avx2"、"sse4.2"或"scalar"
+const char *http_scan_impl();
+
+// 根据首部名(不含':'，不区分大小写)查找对应的首部
+HTTP_HEADER http_header_lookup(const char *name, int len);
+
+#endif
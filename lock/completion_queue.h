@@ -0,0 +1,86 @@
+#ifndef COMPLETION_QUEUE_H
+#define COMPLETION_QUEUE_H
+
+#include <vector>
+#include <exception>
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include "locker.h"
+
+// 一条回传结果：需要关闭的连接及其代数，代数与连接当前的不同说明fd已被新连接复用
+// io_uring模式下回传的是连接处理完请求后需要提交的下一个I/O
+struct completion
+{
+    int sockfd;
+    unsigned generation;
+    int next; // io_uring模式下的http_conn::URING_NEXT，epoll模式下不使用
+};
+
+/*
+工作线程向事件循环回传处理结果的通道
+    工作线程把需要关闭的连接放入队列，队列由空变为非空时写一次eventfd
+    事件循环把eventfd注册到自己的epoll上，可读时一次性取走队列中全部结果
+Reactor模式下主线程因此不必在投递任务后忙等工作线程
+*/
+class completion_queue
+{
+public:
+    completion_queue()
+    {
+        // EFD_NONBLOCK: 取结果时即使计数为0也不会阻塞事件循环
+        m_eventfd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (m_eventfd < 0)
+        {
+            throw std::exception();
+        }
+    }
+    ~completion_queue()
+    {
+        close(m_eventfd);
+    }
+
+    // 注册到epoll上的文件描述符
+    int get_fd()
+    {
+        return m_eventfd;
+    }
+
+    // 工作线程调用，通知事件循环关闭sockfd，io_uring模式下通知为sockfd提交next
+    void post(int sockfd, unsigned generation, int next = 0)
+    {
+        completion c = {sockfd, generation, next};
+        m_mutex.lock();
+        bool was_empty = m_queue.empty();
+        m_queue.push_back(c);
+        m_mutex.unlock();
+
+        // 队列非空说明已有未被取走的通知，无需重复唤醒
+        if (was_empty)
+        {
+            uint64_t one = 1;
+            ssize_t ret = ::write(m_eventfd, &one, sizeof(one));
+            (void)ret;
+        }
+    }
+
+    // 事件循环调用，先清零eventfd再取走队列，保证之后投递的结果一定会再次唤醒
+    void drain(std::vector<completion> &out)
+    {
+        uint64_t count;
+        ssize_t ret = ::read(m_eventfd, &count, sizeof(count));
+        (void)ret;
+
+        out.clear();
+        m_mutex.lock();
+        out.swap(m_queue); // 交换而非拷贝，两个vector的容量来回复用，稳定后不再分配内存
+        m_mutex.unlock();
+    }
+
+private:
+    int m_eventfd;           // 唤醒事件循环的eventfd
+    locker m_mutex;          // 保护队列的互斥锁
+    std::vector<completion> m_queue; // 待关闭(io_uring模式下待提交I/O)的连接
+};
+
+#endif
@@ -144,7 +144,6 @@ void Log::write_log(int level, const char *format, ...)
     va_list valst;
     va_start(valst, format);
 
-    string log_str;
     m_mutex.lock();
 
     // 写入的具体时间内容格式
@@ -153,20 +152,21 @@ void Log::write_log(int level, const char *format, ...)
                      my_tm.tm_hour, my_tm.tm_min, my_tm.tm_sec, now.tv_usec, s);
 
     int m = vsnprintf(m_buf + n, m_log_buf_size - n - 1, format, valst);
+    if (m > m_log_buf_size - n - 2)
+        m = m_log_buf_size - n - 2;
     m_buf[n + m] = '\n';
     m_buf[n + m + 1] = '\0';
-    log_str = m_buf;
-
-    m_mutex.unlock();
 
+    // 同步写直接写出m_buf，只有异步写需要复制一份放入阻塞队列
     if (m_is_async && !m_log_queue->full())
     {
+        string log_str(m_buf, n + m + 1);
+        m_mutex.unlock();
         m_log_queue->push(log_str);
     }
     else
     {
-        m_mutex.lock();
-        fputs(log_str.c_str(), m_fp);
+        fputs(m_buf, m_fp);
         m_mutex.unlock();
     }
 
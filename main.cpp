@@ -6,6 +6,8 @@
 [-p port] [-l LOGWrite] [-m TRIGMode]
 [-o OPT_LINGER] [-s sql_num] [-t thread_num] 
 [-c close_log] [-a actor_model]
+[-n loop_num] [-u io_uring] [-f cache_ttl]
+[-b read_buf_max] [-q task_queue]
 argv[]存放启动server时传入的参数，如上
 */
 int main(int argc, char *argv[])
@@ -27,11 +29,18 @@ int main(int argc, char *argv[])
     */
     server.init(config.PORT, user, passwd, databasename, config.LOGWrite,
                 config.OPT_LINGER, config.TRIGMode, config.sql_num, config.thread_num,
-                config.close_log, config.actor_model);
+                config.close_log, config.actor_model, config.loop_num, config.io_uring,
+                config.cache_ttl, config.read_buf_max, config.task_queue);
 
     // 日志
     server.log_write();
 
+    // 静态文件缓存
+    server.file_cache_init();
+
+    // 读缓冲区池
+    server.buffer_pool_init();
+
     // 数据库
     server.sql_pool();
 
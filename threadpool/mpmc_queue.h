@@ -0,0 +1,192 @@
+#ifndef MPMC_QUEUE_H
+#define MPMC_QUEUE_H
+
+#include <atomic>
+#include <exception>
+#include <stddef.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+/*
+无锁有界多生产者多消费者任务队列(Dmitry Vyukov的环形队列)
+    环形数组的每个槽位带一个序号，生产者和消费者各自用CAS推进enqueue/dequeue位置，
+    再根据槽位序号判断槽位是否可写/可读，提交和取任务都不加锁、不分配内存
+    队列为空时工作线程通过futex挂起，只有存在挂起的线程时提交才需要系统调用
+接口与work_steal_queue相同，可作为threadpool的队列策略
+*/
+template <typename T>
+class mpmc_queue
+{
+public:
+    mpmc_queue(int worker_number, int max_requests);
+    ~mpmc_queue();
+
+    // 提交任务，等待处理的任务数达到上限时返回false
+    bool push(T *request);
+    // 取任务，没有任务时阻塞，worker仅为与work_steal_queue接口一致
+    T *pop(int worker);
+
+private:
+    struct cell
+    {
+        std::atomic<size_t> sequence; // 槽位序号，等于pos表示可写，等于pos+1表示可读
+        T *data;
+    };
+
+    bool try_push(T *request);
+    T *try_pop();
+
+    static const int SPIN_COUNT = 64; // 挂起前的自旋次数
+
+    cell *m_buffer;
+    size_t m_mask;          // 环形数组大小为2的幂，取模变为按位与
+    size_t m_max_requests;  // 等待处理的任务数上限
+
+    // 生产者和消费者的位置分别独占缓存行，避免伪共享
+    char m_pad0[64];
+    std::atomic<size_t> m_enqueue_pos;
+    char m_pad1[64];
+    std::atomic<size_t> m_dequeue_pos;
+    char m_pad2[64];
+    std::atomic<int> m_futex;   // futex等待的字，每次唤醒前递增
+    std::atomic<int> m_waiters; // 挂起或即将挂起的工作线程数
+};
+
+template <typename T>
+mpmc_queue<T>::mpmc_queue(int worker_number, int max_requests)
+    : m_enqueue_pos(0), m_dequeue_pos(0), m_futex(0), m_waiters(0)
+{
+    if (worker_number <= 0 || max_requests <= 0)
+        throw std::exception();
+
+    size_t size = 2;
+    while (size < (size_t)max_requests)
+        size <<= 1;
+    m_mask = size - 1;
+    m_max_requests = max_requests;
+
+    m_buffer = new cell[size];
+    for (size_t i = 0; i < size; ++i)
+        m_buffer[i].sequence.store(i, std::memory_order_relaxed);
+}
+
+template <typename T>
+mpmc_queue<T>::~mpmc_queue()
+{
+    delete[] m_buffer;
+}
+
+template <typename T>
+bool mpmc_queue<T>::push(T *request)
+{
+    if (!try_push(request))
+        return false;
+
+    // 与pop中m_waiters递增后的再次检查配对，保证不会漏掉唤醒
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (m_waiters.load(std::memory_order_relaxed) > 0)
+    {
+        m_futex.fetch_add(1, std::memory_order_relaxed);
+        syscall(SYS_futex, (int *)&m_futex, FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0);
+    }
+    return true;
+}
+
+template <typename T>
+T *mpmc_queue<T>::pop(int worker)
+{
+    (void)worker;
+    while (true)
+    {
+        for (int i = 0; i < SPIN_COUNT; ++i)
+        {
+            T *request = try_pop();
+            if (request)
+                return request;
+        }
+
+        // 先记下futex的值再登记为等待者，之后提交的任务一定会改变该值或被下面的检查取到
+        int seq = m_futex.load(std::memory_order_relaxed);
+        m_waiters.fetch_add(1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        T *request = try_pop();
+        if (request)
+        {
+            m_waiters.fetch_sub(1, std::memory_order_relaxed);
+            return request;
+        }
+        syscall(SYS_futex, (int *)&m_futex, FUTEX_WAIT_PRIVATE, seq, NULL, NULL, 0);
+        m_waiters.fetch_sub(1, std::memory_order_relaxed);
+    }
+}
+
+template <typename T>
+bool mpmc_queue<T>::try_push(T *request)
+{
+    size_t pos = m_enqueue_pos.load(std::memory_order_relaxed);
+    while (true)
+    {
+        // 保持原有的拒绝语义：等待处理的任务数达到上限时拒绝
+        // pos过期时可能小于dequeue位置，交给下面的序号检查重新读取
+        size_t dequeue_pos = m_dequeue_pos.load(std::memory_order_acquire);
+        if (pos >= dequeue_pos && pos - dequeue_pos >= m_max_requests)
+            return false;
+
+        cell *c = &m_buffer[pos & m_mask];
+        size_t seq = c->sequence.load(std::memory_order_acquire);
+        intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+        if (diff == 0)
+        {
+            if (m_enqueue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+            {
+                c->data = request;
+                c->sequence.store(pos + 1, std::memory_order_release);
+                return true;
+            }
+        }
+        else if (diff < 0)
+        {
+            // 槽位上一轮的任务还未被取走，队列已满
+            return false;
+        }
+        else
+        {
+            pos = m_enqueue_pos.load(std::memory_order_relaxed);
+        }
+    }
+}
+
+template <typename T>
+T *mpmc_queue<T>::try_pop()
+{
+    size_t pos = m_dequeue_pos.load(std::memory_order_relaxed);
+    while (true)
+    {
+        cell *c = &m_buffer[pos & m_mask];
+        size_t seq = c->sequence.load(std::memory_order_acquire);
+        intptr_t diff = (intptr_t)seq - (intptr_t)(pos + 1);
+        if (diff == 0)
+        {
+            if (m_dequeue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+            {
+                T *request = c->data;
+                // 槽位留给下一轮的生产者
+                c->sequence.store(pos + m_mask + 1, std::memory_order_release);
+                return request;
+            }
+        }
+        else if (diff < 0)
+        {
+            // 队列为空
+            return NULL;
+        }
+        else
+        {
+            pos = m_dequeue_pos.load(std::memory_order_relaxed);
+        }
+    }
+}
+
+#endif
@@ -1,12 +1,13 @@
 #ifndef THREADPOOL_H
 #define THREADPOOL_H
 
-#include <list>
 #include <cstdio>
+#include <atomic>
 #include <exception>
 #include <pthread.h>
 #include "../lock/locker.h"
-#include "../CGImysql/sql_connection_pool.h"
+#include "work_steal_queue.h"
+#include "mpmc_queue.h"
 
 // 线程池
 /*
@@ -14,13 +15,28 @@
 池是一组资源的集合,这组资源在服务器启动之初就被完全创建好并初始化,这称为静态资源.
 当服务器进入正式运行阶段,开始处理客户请求的时候,如果它需要相关的资源,可以直接从池中获取,无需动态分配.
 当服务器处理完一个客户连接后,可以把相关的资源放回池中,无需执行系统调用释放资源.
+
+T需提供pin()/unpin()：任务入队前pin()，工作线程处理完后unpin()，期间连接对象不会被释放
+任务队列由模板参数Queue决定，需提供Queue(worker_number, max_requests)、bool push(T*)、T *pop(int worker)
+    work_steal_queue: 每个工作线程一个带锁的队列，空闲时互相窃取(默认)
+    mpmc_queue: 所有工作线程共享一个无锁环形队列(-q 1)
 */
+// 线程池的公共接口，服务器按-q选项在运行时选择任务队列
 template <typename T>
-class threadpool
+class task_pool
+{
+public:
+    virtual ~task_pool() {}
+    virtual bool append(T *request, int state) = 0;
+    virtual bool append_p(T *request) = 0;
+};
+
+template <typename T, typename Queue = work_steal_queue<T> >
+class threadpool : public task_pool<T>
 {
 public:
     /*thread_number是线程池中线程的数量，max_requests是请求队列中最多允许的、等待处理的请求的数量*/
-    threadpool(int actor_model, connection_pool *connPool, int thread_number = 8, int max_request = 10000);
+    threadpool(int actor_model, int thread_number = 8, int max_request = 10000);
     ~threadpool();
 
     //向请求队列中插入任务请求
@@ -33,21 +49,17 @@ private:
     void run();
 
 private:
-    int m_thread_number;         // 线程池中的线程数
-    int m_max_requests;          // 请求队列中允许的最大请求数
-    pthread_t *m_threads;        // 描述线程池的数组，其大小为m_thread_number
-    std::list<T *> m_workqueue;  // 工作队列
-    locker m_queuelocker;        // 保护请求队列的互斥锁
-    sem m_queuestat;             // 信号量，标记是否有任务需要处理
-    connection_pool *m_connPool; // 数据库连接池
-    int m_actor_model;           // 模型切换
+    int m_thread_number;            // 线程池中的线程数
+    int m_max_requests;             // 请求队列中允许的最大请求数
+    pthread_t *m_threads;           // 描述线程池的数组，其大小为m_thread_number
+    Queue m_workqueue;              // 工作队列
+    std::atomic<int> m_next_worker; // 为启动的工作线程分配编号
+    int m_actor_model;              // 模型切换
 };
 //threadpool<http_conn> T为：http_conn
-template <typename T>
-threadpool<T>::threadpool(int actor_model, connection_pool *connPool, int thread_number, int max_requests) : m_actor_model(actor_model), m_thread_number(thread_number), m_max_requests(max_requests), m_threads(NULL), m_connPool(connPool)
+template <typename T, typename Queue>
+threadpool<T, Queue>::threadpool(int actor_model, int thread_number, int max_requests) : m_thread_number(thread_number), m_max_requests(max_requests), m_threads(NULL), m_workqueue(thread_number, max_requests), m_next_worker(0), m_actor_model(actor_model)
 {
-    if (thread_number <= 0 || max_requests <= 0)
-        throw std::exception();
     // 创建线程池数组
     m_threads = new pthread_t[m_thread_number];
     if (!m_threads)
@@ -86,48 +98,42 @@ threadpool<T>::threadpool(int actor_model, connection_pool *connPool, int thread
 }
 
 // 析构函数
-template <typename T>
-threadpool<T>::~threadpool()
+template <typename T, typename Queue>
+threadpool<T, Queue>::~threadpool()
 {
     delete[] m_threads;
 }
 
 // 往队列中添加任务
-/*要配合锁执行*/
-template <typename T>
-bool threadpool<T>::append(T *request, int state)
+/*等待处理的任务数达到m_max_requests时拒绝*/
+template <typename T, typename Queue>
+bool threadpool<T, Queue>::append(T *request, int state)
 {
-    m_queuelocker.lock(); // 上锁
-    if (m_workqueue.size() >= m_max_requests)
+    request->m_state = state; // 请求状态，须在任务对工作线程可见之前写入
+    request->pin();
+    if (!m_workqueue.push(request))
     {
-        m_queuelocker.unlock(); // 解锁
+        request->unpin();
         return false;
     }
-    request->m_state = state;       // 请求状态
-    m_workqueue.push_back(request); // 往工作队列中加入请求
-    m_queuelocker.unlock();         // 解锁
-    m_queuestat.post();             // 信号量+1
     return true;
 }
 
-template <typename T>
-bool threadpool<T>::append_p(T *request)
+template <typename T, typename Queue>
+bool threadpool<T, Queue>::append_p(T *request)
 {
-    m_queuelocker.lock();
-    if (m_workqueue.size() >= m_max_requests)
+    request->pin();
+    if (!m_workqueue.push(request))
     {
-        m_queuelocker.unlock();
+        request->unpin();
         return false;
     }
-    m_workqueue.push_back(request);
-    m_queuelocker.unlock();
-    m_queuestat.post();
     return true;
 }
 
 // 工作函数
-template <typename T>
-void *threadpool<T>::worker(void *arg)
+template <typename T, typename Queue>
+void *threadpool<T, Queue>::worker(void *arg)
 {
     threadpool *pool = (threadpool *)arg; // 获取传入的this指针
     pool->run();
@@ -135,22 +141,13 @@ void *threadpool<T>::worker(void *arg)
 }
 
 // 让线程运行起来
-template <typename T>
-void threadpool<T>::run()
+template <typename T, typename Queue>
+void threadpool<T, Queue>::run()
 {
+    int index = m_next_worker++; // 本线程对应的工作队列
     while (true)
     {
-        m_queuestat.wait();   // 获取信号量，如果为0则阻塞，依次来判断能否继续执行
-        m_queuelocker.lock(); // 上锁
-        // 判断工作队列是否为空
-        if (m_workqueue.empty())
-        {
-            m_queuelocker.unlock();
-            continue;
-        }
-        T *request = m_workqueue.front(); // 获取一个任务
-        m_workqueue.pop_front();          // 从队列中删除该任务
-        m_queuelocker.unlock();           // 解锁
+        T *request = m_workqueue.pop(index); // 获取一个任务，没有任务时阻塞
 
         if (!request)
             continue;
@@ -162,41 +159,39 @@ void threadpool<T>::run()
         if (1 == m_actor_model)
         {
             // m_state 读：0 写：1
+            // 读写失败时通过完成队列通知事件循环关闭连接，主线程不等待工作线程
             //读请求
             if (0 == request->m_state) 
             {
                 if (request->read_once())
                 {
-                    request->improv = 1;
-                    connectionRAII mysqlcon(&request->mysql, m_connPool);
                     request->process();
                 }
                 else
                 {
-                    request->improv = 1;
-                    request->timer_flag = 1;
+                    request->notify_close();
                 }
             }
             //写请求
             else
             {
-                if (request->write())
+                if (!request->write())
                 {
-                    request->improv = 1;
+                    request->notify_close();
                 }
-                else
+                // 读缓冲区中还有流水线请求，在本线程继续处理
+                else if (request->pipelined())
                 {
-                    request->improv = 1;
-                    request->timer_flag = 1;
+                    request->process();
                 }
             }
         }
         //Proactor模式
         else
         {
-            connectionRAII mysqlcon(&request->mysql, m_connPool);
             request->process();
         }
+        request->unpin(); // 此后连接可能随slab一起被释放
     }
 }
 #endif
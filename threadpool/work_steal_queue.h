@@ -0,0 +1,250 @@
+#ifndef WORK_STEAL_QUEUE_H
+#define WORK_STEAL_QUEUE_H
+
+#include <atomic>
+#include <exception>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#include "../lock/locker.h"
+
+/*
+工作窃取任务队列
+    每个工作线程一个有界双端队列(环形数组)，各自一把锁，提交和取任务不再争抢同一个互斥锁
+    提交：工作线程提交到自己的队列，其他线程在两个候选队列中选较短的一个(power of two choices)
+    取任务：先从自己队列的头部取，为空时从其他队列的尾部窃取
+    阻塞：每个工作线程在自己的futex上挂起，提交时只有存在挂起的线程才需要唤醒，
+        优先唤醒任务所在队列的线程，它没有挂起时唤醒另一个挂起的线程来窃取
+    容量：每个队列约为max_requests / worker_number，所在队列满时放入其他有空位的队列
+*/
+template <typename T>
+class work_steal_queue
+{
+public:
+    work_steal_queue(int worker_number, int max_requests);
+    ~work_steal_queue();
+
+    // 提交任务，等待处理的任务数达到上限时返回false
+    bool push(T *request);
+    // 第worker个工作线程取任务，没有任务时阻塞
+    T *pop(int worker);
+
+private:
+    // 单个工作线程的有界双端队列，各占独立的缓存行
+    struct alignas(64) deque
+    {
+        locker lock;
+        T **slots;               // 环形数组
+        int head;                // 队首下标
+        int count;               // 当前任务数
+        std::atomic<int> size;   // 任务数的无锁副本，用于挑选较短的队列和跳过空队列
+        std::atomic<int> futex;  // 所属工作线程挂起时等待的字，每次唤醒前递增
+        std::atomic<bool> parked; // 所属工作线程已挂起或即将挂起，由唤醒方或该线程自己清除
+    };
+
+    bool push_to(deque &q, T *request); // 队列满时返回false
+    T *pop_front(deque &q);             // 所属工作线程从头部取
+    T *pop_back(deque &q);              // 其他工作线程从尾部窃取
+    T *take(int worker);                // 取自己的队列，再从其他队列窃取
+    void wake(int target);              // 唤醒一个挂起的工作线程，优先target
+
+    int m_worker_number;             // 工作线程数，即队列数
+    int m_capacity;                  // 每个队列的容量
+    int m_max_requests;              // 等待处理的任务数上限
+    deque *m_queues;                 // 每个工作线程一个队列
+    std::atomic<int> m_pending;      // 等待处理的任务总数
+    std::atomic<unsigned> m_cursor;  // 非工作线程提交时轮转挑选候选队列
+    std::atomic<int> m_parked;       // 挂起的工作线程数，为0时提交不必查找要唤醒的线程
+
+    static __thread work_steal_queue *t_owner; // 当前线程所属的任务队列
+    static __thread int t_worker;               // 当前线程在所属队列中的编号
+};
+
+template <typename T>
+__thread work_steal_queue<T> *work_steal_queue<T>::t_owner = NULL;
+template <typename T>
+__thread int work_steal_queue<T>::t_worker = -1;
+
+template <typename T>
+work_steal_queue<T>::work_steal_queue(int worker_number, int max_requests)
+    : m_worker_number(worker_number), m_max_requests(max_requests), m_pending(0), m_cursor(0), m_parked(0)
+{
+    if (worker_number <= 0 || max_requests <= 0)
+        throw std::exception();
+
+    // 各队列容量之和不小于m_max_requests，任务数未达上限时总有队列有空位
+    m_capacity = (max_requests + worker_number - 1) / worker_number;
+    m_queues = new deque[m_worker_number];
+    for (int i = 0; i < m_worker_number; ++i)
+    {
+        m_queues[i].slots = new T *[m_capacity];
+        m_queues[i].head = 0;
+        m_queues[i].count = 0;
+        m_queues[i].size = 0;
+        m_queues[i].futex = 0;
+        m_queues[i].parked = false;
+    }
+}
+
+template <typename T>
+work_steal_queue<T>::~work_steal_queue()
+{
+    for (int i = 0; i < m_worker_number; ++i)
+        delete[] m_queues[i].slots;
+    delete[] m_queues;
+}
+
+template <typename T>
+bool work_steal_queue<T>::push(T *request)
+{
+    // 保持原有的拒绝语义：等待处理的任务数达到上限时拒绝
+    if (m_pending.fetch_add(1) >= m_max_requests)
+    {
+        m_pending.fetch_sub(1);
+        return false;
+    }
+
+    int target;
+    if (t_owner == this)
+    {
+        // 工作线程提交的任务放入自己的队列
+        target = t_worker;
+    }
+    else
+    {
+        // 两个候选队列中选较短的一个
+        unsigned cursor = m_cursor.fetch_add(1, std::memory_order_relaxed);
+        int a = cursor % m_worker_number;
+        int b = (cursor / m_worker_number + a + 1) % m_worker_number;
+        target = m_queues[b].size.load(std::memory_order_relaxed) < m_queues[a].size.load(std::memory_order_relaxed) ? b : a;
+    }
+
+    // 目标队列满时依次尝试其他队列
+    int i = 0;
+    while (i < m_worker_number && !push_to(m_queues[(target + i) % m_worker_number], request))
+        ++i;
+    if (i == m_worker_number)
+    {
+        m_pending.fetch_sub(1);
+        return false;
+    }
+
+    // 与pop中登记挂起后的再次检查配对，保证不会漏掉唤醒
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (m_parked.load(std::memory_order_relaxed) > 0)
+        wake((target + i) % m_worker_number);
+    return true;
+}
+
+template <typename T>
+T *work_steal_queue<T>::pop(int worker)
+{
+    t_owner = this;
+    t_worker = worker;
+
+    deque &q = m_queues[worker];
+    while (true)
+    {
+        T *request = take(worker);
+        if (request)
+            return request;
+
+        // 先记下futex的值再登记为挂起，之后提交的任务一定会改变该值或被下面的检查取到
+        int seq = q.futex.load(std::memory_order_relaxed);
+        q.parked.store(true, std::memory_order_relaxed);
+        m_parked.fetch_add(1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        request = take(worker);
+        if (!request)
+            syscall(SYS_futex, (int *)&q.futex, FUTEX_WAIT_PRIVATE, seq, NULL, NULL, 0);
+        // 没有被唤醒方清除时自己清除
+        if (q.parked.exchange(false))
+            m_parked.fetch_sub(1, std::memory_order_relaxed);
+        if (request)
+            return request;
+    }
+}
+
+template <typename T>
+T *work_steal_queue<T>::take(int worker)
+{
+    // 先取自己的队列
+    T *request = pop_front(m_queues[worker]);
+    // 再依次从其他队列窃取
+    for (int i = 1; !request && i < m_worker_number; ++i)
+        request = pop_back(m_queues[(worker + i) % m_worker_number]);
+    if (request)
+        m_pending.fetch_sub(1);
+    return request;
+}
+
+template <typename T>
+void work_steal_queue<T>::wake(int target)
+{
+    // 清除挂起标记的一方负责唤醒，同一个挂起的线程不会被两次提交重复唤醒
+    for (int i = 0; i < m_worker_number; ++i)
+    {
+        deque &q = m_queues[(target + i) % m_worker_number];
+        if (q.parked.load(std::memory_order_relaxed) && q.parked.exchange(false))
+        {
+            m_parked.fetch_sub(1, std::memory_order_relaxed);
+            q.futex.fetch_add(1, std::memory_order_relaxed);
+            syscall(SYS_futex, (int *)&q.futex, FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0);
+            return;
+        }
+    }
+}
+
+template <typename T>
+bool work_steal_queue<T>::push_to(deque &q, T *request)
+{
+    q.lock.lock();
+    if (q.count == m_capacity)
+    {
+        q.lock.unlock();
+        return false;
+    }
+    q.slots[(q.head + q.count) % m_capacity] = request;
+    ++q.count;
+    q.size.store(q.count, std::memory_order_relaxed);
+    q.lock.unlock();
+    return true;
+}
+
+template <typename T>
+T *work_steal_queue<T>::pop_front(deque &q)
+{
+    // 空队列不加锁
+    if (q.size.load(std::memory_order_relaxed) == 0)
+        return NULL;
+    T *request = NULL;
+    q.lock.lock();
+    if (q.count > 0)
+    {
+        request = q.slots[q.head];
+        q.head = (q.head + 1) % m_capacity;
+        --q.count;
+        q.size.store(q.count, std::memory_order_relaxed);
+    }
+    q.lock.unlock();
+    return request;
+}
+
+template <typename T>
+T *work_steal_queue<T>::pop_back(deque &q)
+{
+    if (q.size.load(std::memory_order_relaxed) == 0)
+        return NULL;
+    T *request = NULL;
+    q.lock.lock();
+    if (q.count > 0)
+    {
+        --q.count;
+        request = q.slots[(q.head + q.count) % m_capacity];
+        q.size.store(q.count, std::memory_order_relaxed);
+    }
+    q.lock.unlock();
+    return request;
+}
+
+#endif
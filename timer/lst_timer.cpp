@@ -1,189 +1,164 @@
 #include "lst_timer.h"
 #include "../http/http_conn.h"
 
-sort_timer_lst::sort_timer_lst()
+time_wheel::time_wheel()
 {
-    head = NULL;
-    tail = NULL;
+    m_slots = NULL;
+    m_slot_num = 0;
+    m_tick_ms = 1;
+    m_current = 0;
 }
 
-// 销毁链表，删除所有定时器
-sort_timer_lst::~sort_timer_lst()
+// 销毁时间轮，删除所有定时器
+time_wheel::~time_wheel()
 {
-    util_timer *tmp = head;
-    while (tmp)
+    for (int i = 0; i < m_slot_num; ++i)
     {
-        head = tmp->next;
-        delete tmp;
-        tmp = head;
+        util_timer *tmp = m_slots[i];
+        while (tmp)
+        {
+            m_slots[i] = tmp->next;
+            delete tmp;
+            tmp = m_slots[i];
+        }
     }
+    delete[] m_slots;
 }
 
-// 将目标定时器timer添加到链表中
-void sort_timer_lst::add_timer(util_timer *timer)
+void time_wheel::init(int tick_ms, int timeout_ms)
+{
+    m_tick_ms = tick_ms;
+    m_slot_num = timeout_ms / tick_ms + 2;
+    m_slots = new util_timer *[m_slot_num];
+    for (int i = 0; i < m_slot_num; ++i)
+        m_slots[i] = NULL;
+    m_current = time_ms() / m_tick_ms;
+}
+
+// 将目标定时器timer添加到时间轮中
+void time_wheel::add_timer(util_timer *timer)
 {
     if (!timer)
     {
         return;
     }
-    // 如果没有头，将添加进来的结点作为头部
-    if (!head)
-    {
-        head = tail = timer;
-        return;
-    }
-    /*
-    如果目标定时器的超时时间小于当前链表中所有定时器的超时时间
-    则把该定时器插入链表头部，作为新链表的头结点
-    否则就需要调用重载函数add_timer()，把它插入链表中合适的位置
-    */
-    if (timer->expire < head->expire)
-    {
-        timer->next = head;
-        head->prev = timer;
-        head = timer;
-        return;
-    }
-    add_timer(timer, head);
+    link(timer);
 }
 
-/* 当某个定时任务发生变化时，调整对应的定时器在链表中的位置。这个函数只考虑被调整的定时器的
-   超时时间延长的情况，即该定时器需要往链表的尾部移动。*/
-void sort_timer_lst::adjust_timer(util_timer *timer)
+/* 定时器的超时时间改变后，将其从原槽位摘下，挂到新超时时间对应的槽位上 */
+void time_wheel::adjust_timer(util_timer *timer)
 {
     if (!timer)
     {
         return;
     }
-    util_timer *tmp = timer->next;
-    // 如果被调整的目标定时器处在链表的尾部，或者该定时器新的超时时间值仍然小于其下一个定时器的超时时间则不用调整
-    if (!tmp || (timer->expire < tmp->expire))
-    {
-        return;
-    }
-    // 如果目标定时器是链表的头节点，则将该定时器从链表中取出并重新插入链表
-    if (timer == head)
-    {
-        head = head->next;
-        head->prev = NULL;
-        timer->next = NULL;
-        add_timer(timer, head);
-    }
-    // 如果目标定时器不是链表的头节点，则将该定时器从链表中取出，然后插入其原来所在位置后的部分链表中
-    else
-    {
-        timer->prev->next = timer->next;
-        timer->next->prev = timer->prev;
-        add_timer(timer, timer->next);
-    }
+    unlink(timer);
+    link(timer);
 }
 
-// 将目标定时器 timer 从链表中删除
-void sort_timer_lst::del_timer(util_timer *timer)
+// 将目标定时器 timer 从时间轮中删除
+void time_wheel::del_timer(util_timer *timer)
 {
     if (!timer)
     {
         return;
     }
-    // 下面这个条件成立表示链表中只有一个定时器，即目标定时器
-    if ((timer == head) && (timer == tail))
+    unlink(timer);
+    delete timer;
+}
+
+/* 每次timerfd到期时执行一次 tick() 函数，处理从上次tick到现在经过的槽位上到期的定时器 */
+void time_wheel::tick()
+{
+    long long cur = time_ms(); // 获取当前时间
+    long long cur_slot = cur / m_tick_ms;
+    if (cur_slot < m_current)
     {
-        delete timer;
-        head = NULL;
-        tail = NULL;
         return;
     }
-    /* 如果链表中至少有两个定时器，且目标定时器是链表的头节点，
-        则将链表的头节点重置为原头节点的下一个节点，然后删除目标定时器。 */
-    if (timer == head)
+    // 经过的时间超过一圈时，每个槽位只需扫描一次
+    long long first = m_current;
+    if (cur_slot - first >= m_slot_num)
     {
-        head = head->next;
-        head->prev = NULL;
-        delete timer;
-        return;
+        first = cur_slot - m_slot_num + 1;
     }
-    /* 如果链表中至少有两个定时器，且目标定时器是链表的尾节点，
-        则将链表的尾节点重置为原尾节点的前一个节点，然后删除目标定时器。*/
-    if (timer == tail)
+    for (long long t = first; t <= cur_slot; ++t)
     {
-        tail = tail->prev;
-        tail->next = NULL;
-        delete timer;
-        return;
+        util_timer *tmp = m_slots[t % m_slot_num];
+        while (tmp)
+        {
+            util_timer *next = tmp->next;
+            /* 同一槽位上还挂着超时时间晚一圈以上的定时器，比较绝对时间判断是否到期 */
+            if (tmp->expire <= cur)
+            {
+                // 先从时间轮中摘下，再调用定时器的回调函数执行定时任务
+                unlink(tmp);
+                tmp->cb_func(tmp->user_data);
+                delete tmp;
+            }
+            tmp = next;
+        }
     }
-    // 如果目标定时器位于链表的中间，则把它前后的定时器串联起来，然后删除目标定时器
-    timer->prev->next = timer->next;
-    timer->next->prev = timer->prev;
-    delete timer;
+    m_current = cur_slot + 1;
 }
 
-/* SIGALARM 信号每次被触发就在其信号处理函数中执行一次 tick() 函数，以处理链表上到期任务。*/
-void sort_timer_lst::tick()
+// 按超时时间挂到对应槽位的链表头部，槽位向上取整保证扫描到该槽位时已经到期
+// 已经过期的定时器挂到下一个待扫描的槽位
+void time_wheel::link(util_timer *timer)
 {
-    if (!head)
+    long long expire_slot = (timer->expire + m_tick_ms - 1) / m_tick_ms;
+    if (expire_slot < m_current)
     {
-        return;
+        expire_slot = m_current;
     }
-
-    time_t cur = time(NULL); // 获取当前系统时间
-    util_timer *tmp = head;
-    // 从头节点开始依次处理每个定时器，直到遇到一个尚未到期的定时器
-    while (tmp)
+    int slot = expire_slot % m_slot_num;
+    timer->slot = slot;
+    timer->prev = NULL;
+    timer->next = m_slots[slot];
+    if (m_slots[slot])
     {
-        /* 因为每个定时器都使用绝对时间作为超时值，所以可以把定时器的超时值和系统当前时间，
-           比较以判断定时器是否到期*/
-        if (cur < tmp->expire)
-        {
-            break;
-        }
-        // 调用定时器的回调函数，以执行定时任务
-        tmp->cb_func(tmp->user_data);
-        // 执行完定时器中的定时任务之后，就将它从链表中删除，并重置链表头节点
-        head = tmp->next;
-
-        if (head)
-        {
-            head->prev = NULL;
-        }
-        delete tmp;
-        tmp = head;
+        m_slots[slot]->prev = timer;
     }
+    m_slots[slot] = timer;
 }
 
-// add_timer函数的重载，将timer添加到head之后的合适的位置，保证链表升序
-void sort_timer_lst::add_timer(util_timer *timer, util_timer *lst_head)
+// 从所在槽位的链表中摘下
+void time_wheel::unlink(util_timer *timer)
 {
-    util_timer *prev = lst_head;
-    util_timer *tmp = prev->next;
-    /* 遍历 list_head 节点之后的部分链表，直到找到一个超时时间大于目标定时器的超时时间节点
-        并将目标定时器插入该节点之前 */
-    while (tmp)
+    if (timer->prev)
     {
-        if (timer->expire < tmp->expire)
-        {
-            prev->next = timer;
-            timer->next = tmp;
-            tmp->prev = timer;
-            timer->prev = prev;
-            break;
-        }
-        prev = tmp;
-        tmp = tmp->next;
+        timer->prev->next = timer->next;
+    }
+    else
+    {
+        m_slots[timer->slot] = timer->next;
     }
-    /* 如果遍历完 lst_head 节点之后的部分链表，仍未找到超时时间大于目标定时器的超时时间的节点，
-          则将目标定时器插入链表尾部，并把它设置为链表新的尾节点。*/
-    if (!tmp)
+    if (timer->next)
     {
-        prev->next = timer;
-        timer->prev = prev;
-        timer->next = NULL;
-        tail = timer;
+        timer->next->prev = timer->prev;
     }
+    timer->prev = NULL;
+    timer->next = NULL;
 }
 
-void Utils::init(int timeslot)
+Utils::~Utils()
 {
-    m_TIMESLOT = timeslot;
+    if (m_timerfd >= 0)
+        close(m_timerfd);
+}
+
+void Utils::init(int tick_ms, int timeout_ms)
+{
+    m_time_wheel.init(tick_ms, timeout_ms);
+
+    // 每个事件循环一个timerfd，随其他事件一起由epoll/io_uring等待，不再依赖SIGALRM
+    m_timerfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    assert(m_timerfd >= 0);
+    struct itimerspec its;
+    its.it_value.tv_sec = tick_ms / 1000;
+    its.it_value.tv_nsec = (tick_ms % 1000) * 1000000L;
+    its.it_interval = its.it_value;
+    timerfd_settime(m_timerfd, 0, &its, NULL);
 }
 
 // 对文件描述符设置非阻塞
@@ -212,16 +187,6 @@ void Utils::addfd(int epollfd, int fd, bool one_shot, int TRIGMode)
     setnonblocking(fd);
 }
 
-// 信号处理函数
-void Utils::sig_handler(int sig)
-{
-    // 为保证函数的可重入性，保留原来的errno
-    int save_errno = errno;
-    int msg = sig;
-    send(u_pipefd[1], (char *)&msg, 1, 0);
-    errno = save_errno;
-}
-
 // 设置信号函数
 void Utils::addsig(int sig, void(handler)(int), bool restart)
 {
@@ -234,11 +199,13 @@ void Utils::addsig(int sig, void(handler)(int), bool restart)
     assert(sigaction(sig, &sa, NULL) != -1);
 }
 
-// 定时处理任务，重新定时以不断触发SIGALRM信号
+// 定时处理任务，读走timerfd的到期次数后扫描时间轮
 void Utils::timer_handler()
 {
-    m_timer_lst.tick();
-    alarm(m_TIMESLOT);
+    uint64_t expirations;
+    ssize_t ret = read(m_timerfd, &expirations, sizeof(expirations));
+    (void)ret;
+    m_time_wheel.tick();
 }
 
 void Utils::show_error(int connfd, const char *info)
@@ -247,14 +214,32 @@ void Utils::show_error(int connfd, const char *info)
     close(connfd);
 }
 
-int *Utils::u_pipefd = 0;
-int Utils::u_epollfd = 0;
+long long time_ms()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
 
 class Utils;
 void cb_func(client_data *user_data)
 {
-    epoll_ctl(Utils::u_epollfd, EPOLL_CTL_DEL, user_data->sockfd, 0);
     assert(user_data);
+    epoll_ctl(user_data->epollfd, EPOLL_CTL_DEL, user_data->sockfd, 0);
     close(user_data->sockfd);
+    user_data->sockfd = -1; // 标记连接已关闭，所在的slab可以被回收
+    user_data->timer = NULL; // 定时器随后由tick()或deal_timer()释放
     http_conn::m_user_count--;
 }
+
+/*
+io_uring模式下的超时回调
+连接上总有一个挂起的recv或writev，直接close不会让它们结束，且fd号可能被新连接复用
+因此只shutdown，挂起的请求随即以0或错误完成，由事件循环在收到完成事件后关闭
+*/
+void uring_cb_func(client_data *user_data)
+{
+    assert(user_data);
+    shutdown(user_data->sockfd, SHUT_RDWR);
+    user_data->timer = NULL; // 定时器随后由tick()释放
+}
@@ -20,8 +20,10 @@
 #include <errno.h>
 #include <sys/wait.h>
 #include <sys/uio.h>
+#include <sys/timerfd.h>
 
 #include <time.h>
+#include <atomic>
 #include "../log/log.h"
 
 class util_timer; // util_timer类前向声明
@@ -30,31 +32,40 @@ class util_timer; // util_timer类前向声明
 struct client_data
 {
     sockaddr_in address; // 客户端socket地址
-    int sockfd;          // socket文件描述符
-    util_timer *timer;   // 定时器
+    std::atomic<int> sockfd; // socket文件描述符，连接关闭后为-1，主循环shrink时会读取其他循环的连接
+    int epollfd;             // 所属事件循环的epoll文件描述符
+    util_timer *timer;       // 定时器
 };
 
 // 定时器类
 class util_timer
 {
 public:
-    util_timer() : prev(NULL), next(NULL) {}
+    util_timer() : prev(NULL), next(NULL), slot(-1) {}
 
 public:
-    time_t expire; // 任务超时时间，这里使用绝对时间
+    long long expire; // 任务超时时间，单调时钟的绝对毫秒数
 
     void (*cb_func)(client_data *); // 任务回调函数
     client_data *user_data;
-    util_timer *prev; // 指向前一个定时器
-    util_timer *next; // 指向后一个定时器
+    util_timer *prev; // 指向同一槽位中的前一个定时器
+    util_timer *next; // 指向同一槽位中的后一个定时器
+    int slot;         // 所在的时间轮槽位
 };
 
-// 定时器链表，升序双向链表，带有头结点和尾结点
-class sort_timer_lst
+/*
+时间轮，每个槽位tick_ms毫秒，超时时间为expire的定时器挂在第(expire / tick_ms) % m_slot_num个槽位的双向链表上
+添加、调整、删除都只需摘链/挂链，与定时器数量无关
+tick时依次扫描上次tick之后经过的槽位，执行其中已到期的定时器
+*/
+class time_wheel
 {
 public:
-    sort_timer_lst();
-    ~sort_timer_lst(); // 链表被销毁时，删除其中所有的定时器
+    time_wheel();
+    ~time_wheel(); // 时间轮被销毁时，删除其中所有的定时器
+
+    // 槽位数由超时时间决定，最长的超时时间加上一次tick的延迟都落在一圈之内
+    void init(int tick_ms, int timeout_ms);
 
     void add_timer(util_timer *timer);
     void adjust_timer(util_timer *timer);
@@ -62,19 +73,23 @@ public:
     void tick();
 
 private:
-    void add_timer(util_timer *timer, util_timer *lst_head);
+    void link(util_timer *timer);
+    void unlink(util_timer *timer);
 
-    util_timer *head; // 头结点
-    util_timer *tail; // 尾结点
+    util_timer **m_slots; // 每个槽位的链表头
+    int m_slot_num;       // 槽位数
+    int m_tick_ms;        // 每个槽位的时长
+    long long m_current;  // 下一个待扫描的槽位序号(从单调时钟起点开始计)
 };
 
 class Utils
 {
 public:
-    Utils() {}
-    ~Utils() {}
+    Utils() : m_timerfd(-1) {}
+    ~Utils();
 
-    void init(int timeslot);
+    // 创建本循环的timerfd，每tick_ms毫秒触发一次，timeout_ms为最长的超时时间
+    void init(int tick_ms, int timeout_ms);
 
     // 对文件描述符设置非阻塞
     int setnonblocking(int fd);
@@ -82,24 +97,23 @@ public:
     // 将内核事件表注册读事件，ET模式，选择开启EPOLLONESHOT
     void addfd(int epollfd, int fd, bool one_shot, int TRIGMode);
 
-    // 信号处理函数
-    static void sig_handler(int sig);
-
     // 设置信号函数
     void addsig(int sig, void(handler)(int), bool restart = true);
 
-    // 定时处理任务，重新定时以不断触发SIGALRM信号
+    // timerfd可读时调用，处理时间轮上到期的定时任务
     void timer_handler();
 
     void show_error(int connfd, const char *info);
 
 public:
-    static int *u_pipefd;
-    sort_timer_lst m_timer_lst;
-    static int u_epollfd;
-    int m_TIMESLOT;
+    int m_timerfd; // 驱动时间轮的timerfd
+    time_wheel m_time_wheel;
 };
 
+// 单调时钟的当前毫秒数，不受系统时间调整影响
+long long time_ms();
+
 void cb_func(client_data *user_data);
+void uring_cb_func(client_data *user_data);
 
 #endif
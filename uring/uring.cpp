@@ -0,0 +1,220 @@
+#include "uring.h"
+
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+uring::uring()
+{
+    m_fd = -1;
+    m_sq_ptr = MAP_FAILED;
+    m_cq_ptr = MAP_FAILED;
+    m_sqes = (struct io_uring_sqe *)MAP_FAILED;
+    m_sq_size = 0;
+    m_cq_size = 0;
+    m_sqe_tail = 0;
+}
+
+uring::~uring()
+{
+    if (m_sqes != MAP_FAILED)
+        munmap(m_sqes, m_sq_entries * sizeof(struct io_uring_sqe));
+    if (m_cq_ptr != MAP_FAILED && m_cq_ptr != m_sq_ptr)
+        munmap(m_cq_ptr, m_cq_size);
+    if (m_sq_ptr != MAP_FAILED)
+        munmap(m_sq_ptr, m_sq_size);
+    if (m_fd >= 0)
+        close(m_fd);
+}
+
+bool uring::init(unsigned entries)
+{
+    struct io_uring_params p;
+    memset(&p, 0, sizeof(p));
+    // 每个连接同一时刻最多一个挂起的请求，CQ取SQ的4倍，突发时由内核的溢出链表兜底(IORING_FEAT_NODROP)
+    p.flags = IORING_SETUP_CQSIZE | IORING_SETUP_CLAMP;
+    p.cq_entries = entries * 4;
+
+    m_fd = syscall(__NR_io_uring_setup, entries, &p);
+    if (m_fd < 0)
+        return false;
+
+    // 需要带超时的io_uring_enter，与epoll_wait的超时参数对应
+    if (!(p.features & IORING_FEAT_EXT_ARG))
+        return false;
+
+    m_sq_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    m_cq_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+
+    // 新内核中SQ和CQ可以用一次mmap映射
+    if (p.features & IORING_FEAT_SINGLE_MMAP)
+    {
+        if (m_cq_size > m_sq_size)
+            m_sq_size = m_cq_size;
+        m_cq_size = m_sq_size;
+    }
+
+    m_sq_ptr = mmap(0, m_sq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_fd, IORING_OFF_SQ_RING);
+    if (m_sq_ptr == MAP_FAILED)
+        return false;
+
+    if (p.features & IORING_FEAT_SINGLE_MMAP)
+        m_cq_ptr = m_sq_ptr;
+    else
+    {
+        m_cq_ptr = mmap(0, m_cq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_fd, IORING_OFF_CQ_RING);
+        if (m_cq_ptr == MAP_FAILED)
+            return false;
+    }
+
+    m_sq_entries = p.sq_entries;
+    m_sqes = (struct io_uring_sqe *)mmap(0, m_sq_entries * sizeof(struct io_uring_sqe), PROT_READ | PROT_WRITE,
+                                         MAP_SHARED | MAP_POPULATE, m_fd, IORING_OFF_SQES);
+    if (m_sqes == MAP_FAILED)
+        return false;
+
+    char *sq = (char *)m_sq_ptr;
+    m_sq_head = (unsigned *)(sq + p.sq_off.head);
+    m_sq_tail = (unsigned *)(sq + p.sq_off.tail);
+    m_sq_mask = *(unsigned *)(sq + p.sq_off.ring_mask);
+    m_sqe_tail = *m_sq_tail;
+
+    // SQ的索引数组与SQE数组一一对应，之后不再修改
+    unsigned *sq_array = (unsigned *)(sq + p.sq_off.array);
+    for (unsigned i = 0; i < m_sq_entries; ++i)
+        sq_array[i] = i;
+
+    char *cq = (char *)m_cq_ptr;
+    m_cq_head = (unsigned *)(cq + p.cq_off.head);
+    m_cq_tail = (unsigned *)(cq + p.cq_off.tail);
+    m_cq_mask = *(unsigned *)(cq + p.cq_off.ring_mask);
+    m_cqes = (struct io_uring_cqe *)(cq + p.cq_off.cqes);
+
+    return true;
+}
+
+struct io_uring_sqe *uring::get_sqe()
+{
+    unsigned head = __atomic_load_n(m_sq_head, __ATOMIC_ACQUIRE);
+    if (m_sqe_tail - head >= m_sq_entries)
+    {
+        // SQ已满，先把已填写的请求交给内核
+        submit_and_wait(0, 0);
+        head = __atomic_load_n(m_sq_head, __ATOMIC_ACQUIRE);
+        if (m_sqe_tail - head >= m_sq_entries)
+            return NULL;
+    }
+    struct io_uring_sqe *sqe = &m_sqes[m_sqe_tail & m_sq_mask];
+    memset(sqe, 0, sizeof(*sqe));
+    ++m_sqe_tail;
+    return sqe;
+}
+
+int uring::submit_and_wait(unsigned wait_nr, int timeout_ms)
+{
+    // 发布tail，内核从head消费到tail
+    __atomic_store_n(m_sq_tail, m_sqe_tail, __ATOMIC_RELEASE);
+    unsigned to_submit = m_sqe_tail - __atomic_load_n(m_sq_head, __ATOMIC_ACQUIRE);
+
+    struct io_uring_getevents_arg arg;
+    struct __kernel_timespec ts;
+    memset(&arg, 0, sizeof(arg));
+    if (timeout_ms >= 0)
+    {
+        ts.tv_sec = timeout_ms / 1000;
+        ts.tv_nsec = (timeout_ms % 1000) * 1000000LL;
+        arg.ts = (uint64_t)(uintptr_t)&ts;
+    }
+
+    unsigned flags = IORING_ENTER_EXT_ARG;
+    if (wait_nr > 0)
+        flags |= IORING_ENTER_GETEVENTS;
+
+    int ret = syscall(__NR_io_uring_enter, m_fd, to_submit, wait_nr, flags, &arg, sizeof(arg));
+    if (ret < 0)
+        return -errno;
+    return ret;
+}
+
+unsigned uring::cq_ready()
+{
+    return __atomic_load_n(m_cq_tail, __ATOMIC_ACQUIRE) - *m_cq_head;
+}
+
+struct io_uring_cqe *uring::cqe_at(unsigned i)
+{
+    return &m_cqes[(*m_cq_head + i) & m_cq_mask];
+}
+
+void uring::cq_advance(unsigned n)
+{
+    __atomic_store_n(m_cq_head, *m_cq_head + n, __ATOMIC_RELEASE);
+}
+
+// 多路accept：一次提交，每来一个连接产生一个CQE，带IORING_CQE_F_MORE表示仍然有效
+bool uring::prep_accept(int fd, bool multishot, uint64_t user_data)
+{
+    struct io_uring_sqe *sqe = get_sqe();
+    if (!sqe)
+        return false;
+    sqe->opcode = IORING_OP_ACCEPT;
+    sqe->fd = fd;
+    if (multishot)
+        sqe->ioprio |= IORING_ACCEPT_MULTISHOT;
+    sqe->user_data = user_data;
+    return true;
+}
+
+bool uring::prep_recv(int fd, void *buf, unsigned len, uint64_t user_data)
+{
+    struct io_uring_sqe *sqe = get_sqe();
+    if (!sqe)
+        return false;
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = fd;
+    sqe->addr = (uint64_t)(uintptr_t)buf;
+    sqe->len = len;
+    sqe->user_data = user_data;
+    return true;
+}
+
+// iovec数组在请求完成前必须保持有效
+bool uring::prep_writev(int fd, const struct iovec *iov, unsigned count, uint64_t user_data)
+{
+    struct io_uring_sqe *sqe = get_sqe();
+    if (!sqe)
+        return false;
+    sqe->opcode = IORING_OP_WRITEV;
+    sqe->fd = fd;
+    sqe->addr = (uint64_t)(uintptr_t)iov;
+    sqe->len = count;
+    sqe->user_data = user_data;
+    return true;
+}
+
+bool uring::prep_poll(int fd, unsigned poll_mask, bool multishot, uint64_t user_data)
+{
+    struct io_uring_sqe *sqe = get_sqe();
+    if (!sqe)
+        return false;
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = fd;
+    sqe->poll32_events = poll_mask;
+    if (multishot)
+        sqe->len = IORING_POLL_ADD_MULTI;
+    sqe->user_data = user_data;
+    return true;
+}
+
+bool uring::prep_close(int fd, uint64_t user_data)
+{
+    struct io_uring_sqe *sqe = get_sqe();
+    if (!sqe)
+        return false;
+    sqe->opcode = IORING_OP_CLOSE;
+    sqe->fd = fd;
+    sqe->user_data = user_data;
+    return true;
+}
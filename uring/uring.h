@@ -0,0 +1,66 @@
+#ifndef URING_H
+#define URING_H
+
+#include <linux/io_uring.h>
+#include <sys/uio.h>
+#include <stdint.h>
+
+/*
+io_uring提交/完成队列的封装，直接使用io_uring_setup/io_uring_enter系统调用，不依赖liburing
+    SQ(提交队列)：用户态填写SQE，更新tail后通过io_uring_enter一次性提交多个请求
+    CQ(完成队列)：内核写入CQE，用户态读取后更新head
+两个环形队列与SQE数组均通过mmap与内核共享，提交和收割本身不产生系统调用
+*/
+class uring
+{
+public:
+    uring();
+    ~uring();
+
+    // 创建io_uring实例，entries为SQ大小，CQ为其4倍
+    bool init(unsigned entries);
+
+    // 获取一个清零的SQE，SQ满时先提交已有请求
+    struct io_uring_sqe *get_sqe();
+
+    // 提交全部未提交的SQE，并等待至少wait_nr个完成事件，timeout_ms<0表示无限等待
+    // 返回值为提交数量，失败返回-errno
+    int submit_and_wait(unsigned wait_nr, int timeout_ms);
+
+    // 完成队列中可读取的CQE数量
+    unsigned cq_ready();
+    // 第i个待处理的CQE
+    struct io_uring_cqe *cqe_at(unsigned i);
+    // 标记前n个CQE已处理
+    void cq_advance(unsigned n);
+
+    // 常用请求的填写，user_data由调用者编码，SQ无法腾出空间时返回false
+    bool prep_accept(int fd, bool multishot, uint64_t user_data);
+    bool prep_recv(int fd, void *buf, unsigned len, uint64_t user_data);
+    bool prep_writev(int fd, const struct iovec *iov, unsigned count, uint64_t user_data);
+    bool prep_poll(int fd, unsigned poll_mask, bool multishot, uint64_t user_data);
+    bool prep_close(int fd, uint64_t user_data);
+
+private:
+    int m_fd; // io_uring实例的文件描述符
+
+    // SQ
+    void *m_sq_ptr;
+    size_t m_sq_size;
+    unsigned *m_sq_head;
+    unsigned *m_sq_tail;
+    unsigned m_sq_mask;
+    unsigned m_sq_entries;
+    unsigned m_sqe_tail; // 本地已填写但未发布给内核的tail
+    struct io_uring_sqe *m_sqes;
+
+    // CQ
+    void *m_cq_ptr;
+    size_t m_cq_size;
+    unsigned *m_cq_head;
+    unsigned *m_cq_tail;
+    unsigned m_cq_mask;
+    struct io_uring_cqe *m_cqes;
+};
+
+#endif
@@ -1,10 +1,27 @@
 #include "webserver.h"
 
-WebServer::WebServer()
+#include <poll.h>
+
+// io_uring请求类型，编码在user_data的高32位，低32位为fd
+enum
+{
+    URING_OP_ACCEPT = 1,
+    URING_OP_RECV,
+    URING_OP_SEND,
+    URING_OP_SIGNAL,
+    URING_OP_TIMER,
+    URING_OP_CLOSE,
+    URING_OP_COMPLETION
+};
+
+static inline uint64_t uring_data(int op, int fd)
 {
-    // http_conn类对象
-    users = new http_conn[MAX_FD]; // 保存所有客户端信息的数组
+    return ((uint64_t)op << 32) | (uint32_t)fd;
+}
 
+// 连接表按需分配，启动时不创建任何连接对象
+WebServer::WebServer() : m_conns(MAX_FD)
+{
     // root文件夹路径
     char server_path[200];
     // getcwd()会将当前工作目录的绝对路径复制到参数server_path所指的内存空间中,参数size为server_path的空间大小。
@@ -14,24 +31,34 @@ WebServer::WebServer()
     strcpy(m_root, server_path);
     strcat(m_root, root); // strcat字符串追加/连接函数
 
-    // 用户定时器数组
-    users_timer = new client_data[MAX_FD];
+    m_loops = NULL;
+    m_loop_num = 0;
+    m_last_shrink = 0;
+    m_signalfd = -1;
+    m_stop = false;
 }
 
 WebServer::~WebServer()
 {
-    close(m_epollfd);
-    close(m_listenfd);
-    close(m_pipefd[1]);
-    close(m_pipefd[0]);
-    delete[] users;
-    delete[] users_timer;
+    if (m_loops)
+    {
+        for (int i = 0; i < m_loop_num; ++i)
+        {
+            close(m_loops[i].epollfd);
+            close(m_loops[i].listenfd);
+            delete m_loops[i].ring;
+        }
+        delete[] m_loops;
+    }
+    if (m_signalfd >= 0)
+        close(m_signalfd);
     delete m_pool;
 }
 
 // 初始化
 void WebServer::init(int port, string user, string passWord, string databaseName, int log_write,
-                     int opt_linger, int trigmode, int sql_num, int thread_num, int close_log, int actor_model)
+                     int opt_linger, int trigmode, int sql_num, int thread_num, int close_log, int actor_model, int loop_num,
+                     int io_uring, int cache_ttl, int read_buf_max, int task_queue)
 {
     m_port = port;
     m_user = user;
@@ -44,6 +71,17 @@ void WebServer::init(int port, string user, string passWord, string databaseName
     m_TRIGMode = trigmode;
     m_close_log = close_log;
     m_actormodel = actor_model;
+    m_loop_num = loop_num;
+    m_io_uring = io_uring;
+    m_cache_ttl = cache_ttl;
+    m_read_buf_max = read_buf_max;
+    m_task_queue = task_queue;
+
+    // signalfd要求信号在所有线程中都被屏蔽，此时日志、数据库、线程池的线程都还未创建，之后创建的线程继承该掩码
+    sigset_t mask;
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &mask, NULL);
 }
 
 /*
@@ -110,6 +148,19 @@ void WebServer::log_write()
     }
 }
 
+// 初始化静态文件缓存
+void WebServer::file_cache_init()
+{
+    file_cache::get_instance()->init(m_cache_ttl);
+    file_cache::get_instance()->preload(m_root);
+}
+
+// 初始化读缓冲区池
+void WebServer::buffer_pool_init()
+{
+    buffer_pool::get_instance()->init(m_read_buf_max * 1024);
+}
+
 // 初始化数据库连接池
 void WebServer::sql_pool()
 {
@@ -117,20 +168,25 @@ void WebServer::sql_pool()
     m_connPool->init("localhost", m_user, m_passWord, m_databaseName, 3306, m_sql_num, m_close_log);
 
     // 初始化数据库读取表
-    users->initmysql_result(m_connPool);
+    http_conn::initmysql_result(m_connPool, m_close_log);
 }
 
 // 初始化线程池
 void WebServer::thread_pool()
 {
-    m_pool = new threadpool<http_conn>(m_actormodel, m_connPool, m_thread_num);
+    // io_uring模式下读写由事件循环提交，工作线程只处理可能阻塞的请求，按proactor方式分派
+    int actor_model = 1 == m_io_uring ? 0 : m_actormodel;
+    if (1 == m_task_queue)
+        m_pool = new threadpool<http_conn, mpmc_queue<http_conn> >(actor_model, m_thread_num);
+    else
+        m_pool = new threadpool<http_conn>(actor_model, m_thread_num);
 }
 
-// 事件监听
+// 创建监听socket
 /*
 服务端首先初始化Socket() --> 和接口进行绑定bind()和监听listen() --> 调用accept()进行阻塞
 */
-void WebServer::eventListen()
+int WebServer::createListenfd(bool reuse_port)
 {
     // 网络编程基础步骤
     /*
@@ -139,13 +195,13 @@ void WebServer::eventListen()
         -type: 指定socket的类型.
         -protocol: 协议 当protocol为0时,会自动选择type类型对应的默认协议.
     */
-    m_listenfd = socket(PF_INET, SOCK_STREAM, 0);
+    int listenfd = socket(PF_INET, SOCK_STREAM, 0);
 
     // assert函数 作用：如果它的条件返回错误，则终止程序执行
     /*
     如果其值为假（即为0），那么它先向stderr打印一条出错信息，然后通过调用 abort 来终止程序运行。
     */
-    assert(m_listenfd >= 0);
+    assert(listenfd >= 0);
 
     /*
     通过linger结构体设置socket断开连接的方式
@@ -169,13 +225,13 @@ void WebServer::eventListen()
     */
     if (0 == m_OPT_LINGER)
     {
-        struct linger tmp = {0, 1};                                       // 在closesocket的时候立刻返回，底层会将未发送完的数据发送完成后再释放资源，优雅的退出。
-        setsockopt(m_listenfd, SOL_SOCKET, SO_LINGER, &tmp, sizeof(tmp)); // 端口复用
+        struct linger tmp = {0, 1};                                     // 在closesocket的时候立刻返回，底层会将未发送完的数据发送完成后再释放资源，优雅的退出。
+        setsockopt(listenfd, SOL_SOCKET, SO_LINGER, &tmp, sizeof(tmp)); // 端口复用
     }
     else if (1 == m_OPT_LINGER)
     {
         struct linger tmp = {1, 1};
-        setsockopt(m_listenfd, SOL_SOCKET, SO_LINGER, &tmp, sizeof(tmp));
+        setsockopt(listenfd, SOL_SOCKET, SO_LINGER, &tmp, sizeof(tmp));
     }
 
     // 绑定
@@ -188,89 +244,157 @@ void WebServer::eventListen()
 
     int flag = 1;
     // setsockopt设置套接字描述符的属性
-    setsockopt(m_listenfd, SOL_SOCKET, SO_REUSEADDR, &flag, sizeof(flag)); //
-    ret = bind(m_listenfd, (struct sockaddr *)&address, sizeof(address));  // 绑定
+    setsockopt(listenfd, SOL_SOCKET, SO_REUSEADDR, &flag, sizeof(flag));
+    /*
+    SO_REUSEPORT允许多个socket绑定同一端口，由内核按四元组哈希把新连接分发到各个监听socket上，
+    多反应堆模式下每个事件循环各自accept，互不争抢同一个监听队列
+    */
+    if (reuse_port)
+    {
+        ret = setsockopt(listenfd, SOL_SOCKET, SO_REUSEPORT, &flag, sizeof(flag));
+        assert(ret >= 0);
+    }
+    ret = bind(listenfd, (struct sockaddr *)&address, sizeof(address)); // 绑定
     assert(ret >= 0);
     /*
     listen函数的第一个参数时即将要监听的socket文件描述符，第二个参数为相应的socket可以排队的最大连接数。
     socket()创建的socket默认是一个主动类型，listen则将socket变成被动类型，等待客户连接请求。
     */
-    ret = listen(m_listenfd, 5); // 监听
+    ret = listen(listenfd, 5); // 监听
     assert(ret >= 0);
 
-    utils.init(TIMESLOT); // timer相关
+    return listenfd;
+}
 
-    // epoll创建内核事件表
-    epoll_event events[MAX_EVENT_NUMBER]; // 事件监听数组
-    m_epollfd = epoll_create(5);          // int epoll_create(int size); 创建一个epoll的句柄，size用来告诉内核这个监听的数目一共有多大。
-    assert(m_epollfd != -1);
+// 事件监听
+void WebServer::eventListen()
+{
+    // 多反应堆模式下每个CPU核一个事件循环，其余模式只有主线程一个
+    if (2 != m_actormodel)
+        m_loop_num = 1;
+    else if (m_loop_num <= 0)
+        m_loop_num = sysconf(_SC_NPROCESSORS_ONLN);
+
+    // 内核不支持io_uring时回退到epoll
+    if (1 == m_io_uring)
+    {
+        uring probe;
+        if (!probe.init(URING_ENTRIES))
+        {
+            LOG_ERROR("%s", "io_uring unavailable, fall back to epoll");
+            m_io_uring = 0;
+            // 线程池已按proactor方式创建，reactor模式的读写也改由事件循环完成
+            if (1 == m_actormodel)
+                m_actormodel = 0;
+        }
+    }
+
+    m_loops = new event_loop[m_loop_num];
+    m_conns.init_readers(m_loop_num);
+    for (int i = 0; i < m_loop_num; ++i)
+    {
+        event_loop *loop = m_loops + i;
+        loop->server = this;
+        loop->listenfd = createListenfd(2 == m_actormodel);
 
-    // 将监听的文件描述符添加到epoll对象中
-    utils.addfd(m_epollfd, m_listenfd, false, m_LISTENTrigmode);
-    http_conn::m_epollfd = m_epollfd; // 将文件描述符同步到http_conn类中
+        loop->utils.init(TIMER_TICK_MS, IDLE_TIMEOUT_MS); // timer相关
 
-    // 使用socketpair函数能够创建一对套节字进行进程间通信（IPC）
-    ret = socketpair(PF_UNIX, SOCK_STREAM, 0, m_pipefd); // m_pipefd[0]和m_pipefd[1]为创建好的两个套接字
-    assert(ret != -1);
-    utils.setnonblocking(m_pipefd[1]);
-    utils.addfd(m_epollfd, m_pipefd[0], false, 0);
+        // io_uring模式下accept、recv、writev都通过提交队列完成，不需要epoll
+        if (1 == m_io_uring)
+        {
+            loop->epollfd = -1;
+            loop->ring = new uring;
+            bool ok = loop->ring->init(URING_ENTRIES);
+            assert(ok);
+            continue;
+        }
+        loop->ring = NULL;
+
+        // epoll创建内核事件表
+        loop->epollfd = epoll_create(5); // int epoll_create(int size); 创建一个epoll的句柄，size用来告诉内核这个监听的数目一共有多大。
+        assert(loop->epollfd != -1);
 
-    utils.addsig(SIGPIPE, SIG_IGN);
-    utils.addsig(SIGALRM, utils.sig_handler, false);
-    utils.addsig(SIGTERM, utils.sig_handler, false);
+        // 将监听的文件描述符添加到epoll对象中
+        loop->utils.addfd(loop->epollfd, loop->listenfd, false, m_LISTENTrigmode);
+        loop->utils.addfd(loop->epollfd, loop->completions.get_fd(), false, 0);
+        loop->utils.addfd(loop->epollfd, loop->utils.m_timerfd, false, 0);
+    }
 
-    // alarm函数的作用是设置一个定时器，在TIMESLOT秒之后，将会发送SIGALRM信号给当前的进程
-    // 如果不对SIGALRM信号进行忽略或者捕捉，默认情况下会退出进程
-    alarm(TIMESLOT);
+    // SIGTERM已在init()中屏蔽，改为从signalfd读取，信号统一由主线程的事件循环处理
+    sigset_t mask;
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGTERM);
+    m_signalfd = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+    assert(m_signalfd != -1);
+    if (!m_loops[0].ring)
+        m_loops[0].utils.addfd(m_loops[0].epollfd, m_signalfd, false, 0);
 
-    // 工具类,信号和描述符基础操作
-    Utils::u_pipefd = m_pipefd;
-    Utils::u_epollfd = m_epollfd;
+    m_loops[0].utils.addsig(SIGPIPE, SIG_IGN);
 }
 
 // 初始化一个用户连接的定时器
-void WebServer::timer(int connfd, struct sockaddr_in client_address)
+void WebServer::timer(event_loop *loop, int connfd, struct sockaddr_in client_address)
 {
-    users[connfd].init(connfd, client_address, m_root, m_CONNTrigmode, m_close_log, m_user, m_passWord, m_databaseName);
+    // fd所在的slab还不存在时在这里分配
+    connection &conn = m_conns.acquire(connfd);
+    conn.http.init(connfd, client_address, m_root, m_CONNTrigmode, m_close_log, loop->epollfd, &loop->completions);
+    conn.http.set_inflight(m_conns.inflight(connfd));
 
     // 初始化client_data数据
     // 创建定时器，设置回调函数和超时时间，绑定用户数据，将定时器添加到链表中
-    users_timer[connfd].address = client_address;
-    users_timer[connfd].sockfd = connfd;
+    conn.data.address = client_address;
+    conn.data.sockfd = connfd;
+    conn.data.epollfd = loop->epollfd;
     util_timer *timer = new util_timer;
-    timer->user_data = &users_timer[connfd];
-    timer->cb_func = cb_func;
-    time_t cur = time(NULL);
-    timer->expire = cur + 3 * TIMESLOT;
-    users_timer[connfd].timer = timer;
-    utils.m_timer_lst.add_timer(timer);
+    timer->user_data = &conn.data;
+    timer->cb_func = loop->ring ? uring_cb_func : cb_func;
+    timer->expire = time_ms() + IDLE_TIMEOUT_MS;
+    conn.data.timer = timer;
+    loop->utils.m_time_wheel.add_timer(timer);
 }
 
-// 若有数据传输，则将定时器往后延迟3个单位
-// 并对新的定时器在链表上的位置进行调整
-void WebServer::adjust_timer(util_timer *timer)
+// 若有数据传输，则将定时器往后延迟一个空闲超时
+// 并对新的定时器在时间轮上的位置进行调整
+void WebServer::adjust_timer(event_loop *loop, util_timer *timer)
 {
-    time_t cur = time(NULL);
-    timer->expire = cur + 3 * TIMESLOT;
-    utils.m_timer_lst.adjust_timer(timer);
+    timer->expire = time_ms() + IDLE_TIMEOUT_MS;
+    loop->utils.m_time_wheel.adjust_timer(timer);
 
     LOG_INFO("%s", "adjust timer once");
 }
 
-// 删除定时器
-void WebServer::deal_timer(util_timer *timer, int sockfd)
+// 关闭连接并删除定时器
+// 同一批事件中前面的事件可能已经关闭了该连接，此时定时器为NULL，不再重复关闭
+void WebServer::deal_timer(event_loop *loop, util_timer *timer, int sockfd)
 {
-    timer->cb_func(&users_timer[sockfd]);
-    if (timer)
-    {
-        utils.m_timer_lst.del_timer(timer);
-    }
+    if (!timer)
+        return;
+    timer->cb_func(&m_conns[sockfd].data);
+    loop->utils.m_time_wheel.del_timer(timer);
+    m_conns[sockfd].data.timer = NULL;
+
+    LOG_INFO("close fd %d", sockfd);
+}
+
+static bool connection_idle(const connection &conn)
+{
+    return conn.data.sockfd.load(std::memory_order_relaxed) < 0;
+}
 
-    LOG_INFO("close fd %d", users_timer[sockfd].sockfd);
+// 每隔CONN_SHRINK_MS把连接全部关闭的slab还给系统，只由主循环调用
+void WebServer::shrinkConns()
+{
+    long long now = time_ms();
+    if (now - m_last_shrink < CONN_SHRINK_MS)
+        return;
+    m_last_shrink = now;
+    int freed = m_conns.shrink(connection_idle);
+    if (freed > 0)
+        LOG_INFO("retire %d idle connection slabs, %d in use", freed, m_conns.slab_count());
 }
 
 // 处理客户端连接
-bool WebServer::dealclinetdata()
+bool WebServer::dealclinetdata(event_loop *loop)
 {
     struct sockaddr_in client_address; // socket地址
     socklen_t client_addrlength = sizeof(client_address);
@@ -286,7 +410,7 @@ bool WebServer::dealclinetdata()
         内核为每个由服务器进程接受的客户端连接创建一个已连接套接字。
         当服务器完成对某个给定的客户端的服务器时，相应的已连接套接字就被关闭。
         */
-        int connfd = accept(m_listenfd, (struct sockaddr *)&client_address, &client_addrlength);
+        int connfd = accept(loop->listenfd, (struct sockaddr *)&client_address, &client_addrlength);
         if (connfd < 0)
         {
             LOG_ERROR("%s:errno is:%d", "accept error", errno);
@@ -294,12 +418,12 @@ bool WebServer::dealclinetdata()
         }
         if (http_conn::m_user_count >= MAX_FD) // 目前的连接数满了
         {
-            utils.show_error(connfd, "Internal server busy");
+            loop->utils.show_error(connfd, "Internal server busy");
             LOG_ERROR("%s", "Internal server busy");
             return false;
         }
 
-        timer(connfd, client_address);
+        timer(loop, connfd, client_address);
     }
 
     // ET边缘触发
@@ -307,7 +431,7 @@ bool WebServer::dealclinetdata()
     {
         while (1)
         {
-            int connfd = accept(m_listenfd, (struct sockaddr *)&client_address, &client_addrlength);
+            int connfd = accept(loop->listenfd, (struct sockaddr *)&client_address, &client_addrlength);
             if (connfd < 0)
             {
                 LOG_ERROR("%s:errno is:%d", "accept error", errno);
@@ -315,11 +439,11 @@ bool WebServer::dealclinetdata()
             }
             if (http_conn::m_user_count >= MAX_FD)
             {
-                utils.show_error(connfd, "Internal server busy");
+                loop->utils.show_error(connfd, "Internal server busy");
                 LOG_ERROR("%s", "Internal server busy");
                 break;
             }
-            timer(connfd, client_address);
+            timer(loop, connfd, client_address);
         }
         return false;
     }
@@ -327,152 +451,174 @@ bool WebServer::dealclinetdata()
 }
 
 // 处理信号
-bool WebServer::dealwithsignal(bool &timeout, bool &stop_server)
+bool WebServer::dealwithsignal(bool &stop_server)
 {
-    int ret = 0;
-    int sig;
-    char signals[1024];
-    ret = recv(m_pipefd[0], signals, sizeof(signals), 0);
-    if (ret == -1)
-    {
-        return false;
-    }
-    else if (ret == 0)
+    struct signalfd_siginfo signals[16];
+    ssize_t ret = read(m_signalfd, signals, sizeof(signals));
+    if (ret <= 0)
     {
         return false;
     }
-    else
+    for (size_t i = 0; i < ret / sizeof(signals[0]); ++i)
     {
-        for (int i = 0; i < ret; ++i)
+        switch (signals[i].ssi_signo)
         {
-            switch (signals[i])
-            {
-            case SIGALRM:
-            {
-                timeout = true;
-                break;
-            }
-            case SIGTERM:
-            {
-                stop_server = true;
-                break;
-            }
-            }
+        case SIGTERM:
+        {
+            stop_server = true;
+            break;
+        }
         }
     }
     return true;
 }
 
 // 处理读事件
-void WebServer::dealwithread(int sockfd)
+void WebServer::dealwithread(event_loop *loop, int sockfd)
 {
-    util_timer *timer = users_timer[sockfd].timer;
+    util_timer *timer = m_conns[sockfd].data.timer;
 
     // reactor
     if (1 == m_actormodel)
     {
         if (timer)
         {
-            adjust_timer(timer);
+            adjust_timer(loop, timer);
         }
 
         // 若监测到读事件，将该事件放入请求队列
-        m_pool->append(users + sockfd, 0);
-
-        while (true)
-        {
-            if (1 == users[sockfd].improv)
-            {
-                if (1 == users[sockfd].timer_flag)
-                {
-                    deal_timer(timer, sockfd);
-                    users[sockfd].timer_flag = 0;
-                }
-                users[sockfd].improv = 0;
-                break;
-            }
-        }
+        // 读取和处理都由工作线程完成，需要关闭连接时通过完成队列通知，事件循环继续处理其他fd
+        m_pool->append(&m_conns[sockfd].http, 0);
     }
     // proactor
     else
     {
 
-        if (users[sockfd].read_once())
+        if (m_conns[sockfd].http.read_once())
         {
-            LOG_INFO("deal with the client(%s)", inet_ntoa(users[sockfd].get_address()->sin_addr));
+            LOG_INFO("deal with the client(%s)", inet_ntoa(m_conns[sockfd].http.get_address()->sin_addr));
 
             // 若监测到读事件，将该事件放入请求队列
-            m_pool->append_p(users + sockfd);
+            m_pool->append_p(&m_conns[sockfd].http);
 
             if (timer)
             {
-                adjust_timer(timer);
+                adjust_timer(loop, timer);
             }
         }
         else
         {
-            deal_timer(timer, sockfd);
+            deal_timer(loop, timer, sockfd);
         }
     }
 }
 
 // 处理写事件
-void WebServer::dealwithwrite(int sockfd)
+void WebServer::dealwithwrite(event_loop *loop, int sockfd)
 {
-    util_timer *timer = users_timer[sockfd].timer;
+    util_timer *timer = m_conns[sockfd].data.timer;
     // reactor
     if (1 == m_actormodel)
     {
         if (timer)
         {
-            adjust_timer(timer);
+            adjust_timer(loop, timer);
         }
 
-        m_pool->append(users + sockfd, 1);
-
-        while (true)
-        {
-            if (1 == users[sockfd].improv)
-            {
-                if (1 == users[sockfd].timer_flag)
-                {
-                    deal_timer(timer, sockfd);
-                    users[sockfd].timer_flag = 0;
-                }
-                users[sockfd].improv = 0;
-                break;
-            }
-        }
+        m_pool->append(&m_conns[sockfd].http, 1);
     }
     else
     {
         // proactor
-        if (users[sockfd].write())
+        if (m_conns[sockfd].http.write())
         {
-            LOG_INFO("send data to the client(%s)", inet_ntoa(users[sockfd].get_address()->sin_addr));
+            LOG_INFO("send data to the client(%s)", inet_ntoa(m_conns[sockfd].http.get_address()->sin_addr));
+
+            // 读缓冲区中还有流水线请求，交给工作线程继续处理
+            if (m_conns[sockfd].http.pipelined())
+                m_pool->append_p(&m_conns[sockfd].http);
 
             if (timer)
             {
-                adjust_timer(timer);
+                adjust_timer(loop, timer);
             }
         }
         else
         {
-            deal_timer(timer, sockfd);
+            deal_timer(loop, timer, sockfd);
         }
     }
 }
 
+// 处理工作线程回传的结果
+void WebServer::dealwithcompletion(event_loop *loop)
+{
+    loop->completions.drain(loop->closing);
+    for (size_t i = 0; i < loop->closing.size(); ++i)
+    {
+        int sockfd = loop->closing[i].sockfd;
+        // 连接已经超时关闭(所在slab可能已被回收)，或者fd已经被新连接复用，通知已经过期
+        connection *conn = m_conns.find(sockfd);
+        if (!conn || conn->data.sockfd < 0 || conn->http.generation() != loop->closing[i].generation)
+            continue;
+        deal_timer(loop, conn->data.timer, sockfd);
+    }
+}
+
+// 多反应堆模式下事件循环线程的入口
+void *WebServer::loop_worker(void *arg)
+{
+    event_loop *loop = (event_loop *)arg;
+    if (loop->ring)
+        loop->server->runUringLoop(loop);
+    else
+        loop->server->runLoop(loop);
+    return loop;
+}
+
 // 运行
 void WebServer::eventLoop()
+{
+    // 多反应堆模式下，m_loops[1..n-1]各自运行在独立线程中，主线程运行m_loops[0]
+    for (int i = 1; i < m_loop_num; ++i)
+    {
+        if (pthread_create(&m_loops[i].tid, NULL, loop_worker, m_loops + i) != 0)
+        {
+            LOG_ERROR("%s", "create event loop thread failure");
+            for (int j = i; j < m_loop_num; ++j)
+                m_conns.offline(j);
+            m_loop_num = i;
+            break;
+        }
+    }
+
+    m_loops[0].tid = pthread_self();
+    if (m_loops[0].ring)
+        runUringLoop(m_loops);
+    else
+        runLoop(m_loops);
+
+    // 其他循环在下一次timerfd到期时看到m_stop后退出，等它们结束后才能释放m_loops
+    m_stop = true;
+    for (int i = 1; i < m_loop_num; ++i)
+        pthread_join(m_loops[i].tid, NULL);
+}
+
+// 运行单个事件循环
+void WebServer::runLoop(event_loop *loop)
 {
     bool timeout = false;
     bool stop_server = false;
 
+    // 每个循环由自己的timerfd驱动时间轮，只有主循环监听signalfd
+    bool main_loop = (loop == m_loops);
+
     while (!stop_server)
     {
+        // 阻塞等待前不持有任何连接的引用，shrink摘下的slab可以在所有循环都经过这里后释放
+        m_conns.quiescent(loop - m_loops);
         // number：检测到的事件个数
-        int number = epoll_wait(m_epollfd, events, MAX_EVENT_NUMBER, -1);
+        int number = epoll_wait(loop->epollfd, loop->events, MAX_EVENT_NUMBER, -1);
         // 处理调用失败
         if (number < 0 && errno != EINTR)
         {
@@ -483,46 +629,271 @@ void WebServer::eventLoop()
         // 循环遍历事件数组
         for (int i = 0; i < number; i++)
         {
-            int sockfd = events[i].data.fd;
+            int sockfd = loop->events[i].data.fd;
 
             // 处理新到的客户连接
-            if (sockfd == m_listenfd) // 有客户端连接进来
+            if (sockfd == loop->listenfd) // 有客户端连接进来
             {
-                bool flag = dealclinetdata();
+                bool flag = dealclinetdata(loop);
                 if (false == flag)
                     continue;
             }
+            // 处理工作线程回传的结果
+            else if (sockfd == loop->completions.get_fd())
+            {
+                dealwithcompletion(loop);
+            }
+            // 定时器到期，等本轮事件处理完再统一处理
+            else if (sockfd == loop->utils.m_timerfd)
+            {
+                timeout = true;
+            }
             // 对方异常断开或者错误等事件
-            else if (events[i].events & (EPOLLRDHUP | EPOLLHUP | EPOLLERR))
+            else if (loop->events[i].events & (EPOLLRDHUP | EPOLLHUP | EPOLLERR))
             {
                 // 服务器端关闭连接，移除对应的定时器
-                util_timer *timer = users_timer[sockfd].timer;
-                deal_timer(timer, sockfd);
+                util_timer *timer = m_conns[sockfd].data.timer;
+                deal_timer(loop, timer, sockfd);
             }
             // 处理信号
-            else if ((sockfd == m_pipefd[0]) && (events[i].events & EPOLLIN))
+            else if (main_loop && (sockfd == m_signalfd) && (loop->events[i].events & EPOLLIN))
             {
-                bool flag = dealwithsignal(timeout, stop_server);
+                bool flag = dealwithsignal(stop_server);
                 if (false == flag)
                     LOG_ERROR("%s", "dealclientdata failure");
             }
             // 处理客户连接上接收到的数据
-            else if (events[i].events & EPOLLIN)
+            else if (loop->events[i].events & EPOLLIN)
             {
-                dealwithread(sockfd);
+                dealwithread(loop, sockfd);
             }
-            else if (events[i].events & EPOLLOUT)
+            else if (loop->events[i].events & EPOLLOUT)
             {
-                dealwithwrite(sockfd);
+                dealwithwrite(loop, sockfd);
             }
         }
         if (timeout)
         {
-            utils.timer_handler();
+            loop->utils.timer_handler();
+            if (main_loop)
+                shrinkConns();
+
+            timeout = false;
+            if (m_stop)
+                stop_server = true;
+        }
+    }
+    m_conns.offline(loop - m_loops);
+}
+
+// io_uring模式下运行单个事件循环
+/*
+与runLoop()的区别：
+    accept使用多路accept，一次提交持续产生新连接
+    recv/writev以SQE的形式提交，完成后直接在本线程解析请求并生成响应
+    一次io_uring_enter同时完成上一轮所有请求的提交和本轮完成事件的收割
+因此每个请求不再需要epoll_wait、recv、writev和两次epoll_ctl等多个系统调用
+*/
+void WebServer::runUringLoop(event_loop *loop)
+{
+    bool timeout = false;
+    bool stop_server = false;
+
+    bool main_loop = (loop == m_loops);
+
+    uring *ring = loop->ring;
+    bool multishot = true; // 旧内核不支持多路accept时退化为每次重新提交
+    ring->prep_accept(loop->listenfd, multishot, uring_data(URING_OP_ACCEPT, loop->listenfd));
+    ring->prep_poll(loop->utils.m_timerfd, POLLIN, true, uring_data(URING_OP_TIMER, loop->utils.m_timerfd));
+    ring->prep_poll(loop->completions.get_fd(), POLLIN, true, uring_data(URING_OP_COMPLETION, loop->completions.get_fd()));
+    if (main_loop)
+        ring->prep_poll(m_signalfd, POLLIN, true, uring_data(URING_OP_SIGNAL, m_signalfd));
+
+    while (!stop_server)
+    {
+        m_conns.quiescent(loop - m_loops);
+        int ret = ring->submit_and_wait(1, -1);
+        // 被信号中断或等待超时
+        if (ret < 0 && ret != -EINTR && ret != -ETIME)
+        {
+            LOG_ERROR("%s:errno is:%d", "io_uring failure", -ret);
+            break;
+        }
+
+        unsigned number = ring->cq_ready();
+        for (unsigned i = 0; i < number; ++i)
+        {
+            struct io_uring_cqe *cqe = ring->cqe_at(i);
+            int op = (int)(cqe->user_data >> 32);
+            int sockfd = (int)(cqe->user_data & 0xffffffff);
+            int res = cqe->res;
+            bool more = cqe->flags & IORING_CQE_F_MORE; // 多路请求是否仍然有效
+
+            switch (op)
+            {
+            case URING_OP_ACCEPT:
+            {
+                if (res >= 0)
+                    uringAccept(loop, res);
+                else if (-EINVAL == res && multishot)
+                    multishot = false;
+                else
+                    LOG_ERROR("%s:errno is:%d", "accept error", -res);
+
+                if (!more)
+                    ring->prep_accept(loop->listenfd, multishot, uring_data(URING_OP_ACCEPT, loop->listenfd));
+                break;
+            }
+            case URING_OP_RECV:
+            {
+                // 对方关闭连接、出错或被超时回调shutdown
+                if (res <= 0)
+                {
+                    uringClose(loop, sockfd);
+                    break;
+                }
+                util_timer *timer = m_conns[sockfd].data.timer;
+                if (timer)
+                {
+                    adjust_timer(loop, timer);
+                }
+
+                uringSubmit(loop, sockfd, m_conns[sockfd].http.recv_done(res));
+                break;
+            }
+            case URING_OP_SEND:
+            {
+                if (res > 0)
+                {
+                    util_timer *timer = m_conns[sockfd].data.timer;
+                    if (timer)
+                    {
+                        adjust_timer(loop, timer);
+                    }
+                }
+                // 发送完后可能紧接着解析读缓冲区中的流水线请求
+                uringSubmit(loop, sockfd, m_conns[sockfd].http.send_done(res > 0 ? res : -EPIPE));
+                break;
+            }
+            case URING_OP_SIGNAL:
+            {
+                bool flag = dealwithsignal(stop_server);
+                if (false == flag)
+                    LOG_ERROR("%s", "dealclientdata failure");
+                if (!more)
+                    ring->prep_poll(m_signalfd, POLLIN, true, uring_data(URING_OP_SIGNAL, m_signalfd));
+                break;
+            }
+            case URING_OP_TIMER:
+            {
+                timeout = true;
+                if (!more)
+                    ring->prep_poll(loop->utils.m_timerfd, POLLIN, true, uring_data(URING_OP_TIMER, loop->utils.m_timerfd));
+                break;
+            }
+            case URING_OP_COMPLETION:
+            {
+                uringCompletion(loop);
+                if (!more)
+                    ring->prep_poll(loop->completions.get_fd(), POLLIN, true,
+                                    uring_data(URING_OP_COMPLETION, loop->completions.get_fd()));
+                break;
+            }
+            default:
+                break;
+            }
+        }
+        ring->cq_advance(number);
 
-            LOG_INFO("%s", "timer tick");
+        if (timeout)
+        {
+            loop->utils.timer_handler();
+            if (main_loop)
+                shrinkConns();
 
             timeout = false;
+            if (m_stop)
+                stop_server = true;
         }
     }
-}
\ No newline at end of file
+    m_conns.offline(loop - m_loops);
+}
+
+// io_uring模式下接受新连接，并提交第一个recv
+void WebServer::uringAccept(event_loop *loop, int connfd)
+{
+    if (http_conn::m_user_count >= MAX_FD)
+    {
+        loop->utils.show_error(connfd, "Internal server busy");
+        LOG_ERROR("%s", "Internal server busy");
+        return;
+    }
+
+    // 多路accept不返回对端地址，io_uring路径上也不记录客户端地址
+    struct sockaddr_in client_address;
+    bzero(&client_address, sizeof(client_address));
+    timer(loop, connfd, client_address);
+    uringSubmit(loop, connfd, http_conn::URING_RECV);
+}
+
+// io_uring模式下按连接的处理结果提交下一个I/O，每个连接同一时刻只有一个挂起的请求
+void WebServer::uringSubmit(event_loop *loop, int sockfd, int next)
+{
+    bool ok = false;
+    if (http_conn::URING_RECV == next)
+    {
+        int len = 0;
+        char *buf = m_conns[sockfd].http.recv_buf(len);
+        ok = buf && loop->ring->prep_recv(sockfd, buf, len, uring_data(URING_OP_RECV, sockfd));
+    }
+    else if (http_conn::URING_SEND == next)
+    {
+        int count = 0;
+        struct iovec *iov = m_conns[sockfd].http.send_iov(count);
+        ok = loop->ring->prep_writev(sockfd, iov, count, uring_data(URING_OP_SEND, sockfd));
+        if (!ok)
+            m_conns[sockfd].http.send_done(-ENOBUFS); // 释放文件映射
+    }
+    // 连接上没有挂起的I/O，工作线程处理完之前事件循环不会再访问它
+    else if (http_conn::URING_WORKER == next)
+    {
+        ok = m_pool->append_p(&m_conns[sockfd].http);
+    }
+
+    if (!ok)
+        uringClose(loop, sockfd);
+}
+
+// io_uring模式下取出工作线程处理完的连接，按处理结果提交下一个I/O
+void WebServer::uringCompletion(event_loop *loop)
+{
+    loop->completions.drain(loop->closing);
+    for (size_t i = 0; i < loop->closing.size(); ++i)
+    {
+        int sockfd = loop->closing[i].sockfd;
+        // 交给工作线程期间连接上没有挂起的I/O，不会被关闭，这里只是与dealwithcompletion()一样做检查
+        connection *conn = m_conns.find(sockfd);
+        if (!conn || conn->data.sockfd < 0 || conn->http.generation() != loop->closing[i].generation)
+            continue;
+        uringSubmit(loop, sockfd, loop->closing[i].next);
+    }
+}
+
+// io_uring模式下关闭连接，此时连接上已没有挂起的请求，fd号不会被误用
+void WebServer::uringClose(event_loop *loop, int sockfd)
+{
+    util_timer *timer = m_conns[sockfd].data.timer;
+    if (timer)
+    {
+        loop->utils.m_time_wheel.del_timer(timer);
+        m_conns[sockfd].data.timer = NULL;
+    }
+    m_conns[sockfd].data.sockfd = -1;
+
+    // close也作为SQE随下一次io_uring_enter一起提交
+    if (!loop->ring->prep_close(sockfd, uring_data(URING_OP_CLOSE, sockfd)))
+        close(sockfd);
+    http_conn::m_user_count--;
+
+    LOG_INFO("close fd %d", sockfd);
+}
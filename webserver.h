@@ -11,13 +11,55 @@
 #include <stdlib.h>
 #include <cassert>
 #include <sys/epoll.h>
+#include <signal.h>
+#include <sys/signalfd.h>
+#include <pthread.h>
+
+#include <vector>
 
 #include "./threadpool/threadpool.h"
 #include "./http/http_conn.h"
+#include "./lock/completion_queue.h"
+#include "./uring/uring.h"
+#include "./conn/conn_table.h"
 
 const int MAX_FD = 65536;           // 最大文件描述符
 const int MAX_EVENT_NUMBER = 10000; // 最大事件监听数
-const int TIMESLOT = 5;             // 最小超时单位
+const int TIMESLOT = 5;             // 最小超时单位(秒)
+const int TIMER_TICK_MS = 100;      // 时间轮每个槽位的时长，也是timerfd的触发间隔
+const int IDLE_TIMEOUT_MS = 3 * TIMESLOT * 1000; // 连接空闲超时
+const int URING_ENTRIES = 1024;     // io_uring提交队列大小
+const int CONN_SHRINK_MS = 10000;   // 主循环检查并释放空闲连接slab的间隔
+
+class WebServer;
+
+// 一个连接槽位：http连接和它的定时器数据，由连接表按fd分配
+struct connection
+{
+    http_conn http;   // http连接
+    client_data data; // 定时器相关，sockfd为-1表示连接已关闭
+
+    connection()
+    {
+        data.sockfd = -1;
+        data.timer = NULL;
+    }
+};
+
+// 事件循环，独占一个epoll实例、一个监听socket和一个时间轮
+// 单反应堆模式(-a 0/1)下只有主线程一个循环，多反应堆模式(-a 2)下每个线程一个
+struct event_loop
+{
+    WebServer *server;                    // 所属的服务器
+    pthread_t tid;                        // 运行该循环的线程
+    int epollfd;                          // epoll文件描述符，io_uring模式下为-1
+    uring *ring;                          // io_uring实例，epoll模式下为NULL
+    int listenfd;                         // 监听socket，多反应堆模式下通过SO_REUSEPORT绑定同一端口
+    Utils utils;                          // 定时器相关，每个循环各自一个时间轮
+    completion_queue completions;         // 工作线程回传的待关闭连接，io_uring模式下为待提交I/O的连接
+    std::vector<completion> closing;      // 从完成队列取出的结果
+    epoll_event events[MAX_EVENT_NUMBER]; // epoll事件数组
+};
 
 class WebServer
 {
@@ -28,21 +70,36 @@ public:
     // 初始化
     void init(int port, string user, string passWord, string databaseName,
               int log_write, int opt_linger, int trigmode, int sql_num,
-              int thread_num, int close_log, int actor_model);
-
-    void thread_pool();                                        // 线程池
-    void sql_pool();                                           // 数据库连接池
-    void log_write();                                          // 日志
-    void trig_mode();                                          // 触发模式
-    void eventListen();                                        // 事件监听
-    void eventLoop();                                          // 运行
-    void timer(int connfd, struct sockaddr_in client_address); // 定时器
-    void adjust_timer(util_timer *timer);                      // 定时器时间调整
-    void deal_timer(util_timer *timer, int sockfd);            // 删除定时器
-    bool dealclinetdata();                                     // 处理客户端连接
-    bool dealwithsignal(bool &timeout, bool &stop_server);     // 处理信号
-    void dealwithread(int sockfd);                             // 处理读事件
-    void dealwithwrite(int sockfd);                            // 处理写事件
+              int thread_num, int close_log, int actor_model, int loop_num, int io_uring,
+              int cache_ttl, int read_buf_max, int task_queue);
+
+    void thread_pool();                                                          // 线程池
+    void sql_pool();                                                             // 数据库连接池
+    void log_write();                                                            // 日志
+    void file_cache_init();                                                      // 静态文件缓存
+    void buffer_pool_init();                                                     // 读缓冲区池
+    void trig_mode();                                                            // 触发模式
+    void eventListen();                                                          // 事件监听
+    void eventLoop();                                                            // 运行
+    void timer(event_loop *loop, int connfd, struct sockaddr_in client_address); // 定时器
+    void adjust_timer(event_loop *loop, util_timer *timer);                      // 定时器时间调整
+    void deal_timer(event_loop *loop, util_timer *timer, int sockfd);            // 删除定时器
+    bool dealclinetdata(event_loop *loop);                                       // 处理客户端连接
+    bool dealwithsignal(bool &stop_server);                                      // 处理信号
+    void dealwithread(event_loop *loop, int sockfd);                             // 处理读事件
+    void dealwithwrite(event_loop *loop, int sockfd);                            // 处理写事件
+    void dealwithcompletion(event_loop *loop);                                   // 处理工作线程回传的结果
+
+private:
+    int createListenfd(bool reuse_port);  // 创建并绑定监听socket
+    void runLoop(event_loop *loop);       // 运行单个事件循环
+    void runUringLoop(event_loop *loop);  // io_uring模式下运行单个事件循环
+    void uringAccept(event_loop *loop, int connfd);                 // io_uring模式下接受新连接
+    void uringSubmit(event_loop *loop, int sockfd, int next);       // io_uring模式下提交连接的下一个I/O
+    void uringCompletion(event_loop *loop);                         // io_uring模式下提交工作线程处理完的连接的I/O
+    void uringClose(event_loop *loop, int sockfd);                  // io_uring模式下关闭连接
+    static void *loop_worker(void *arg);  // 多反应堆模式下事件循环线程的入口
+    void shrinkConns();                   // 主循环定期释放连接全部关闭的slab
 
 public:
     // 基础
@@ -51,10 +108,16 @@ public:
     int m_log_write;  // 日志写入方式
     int m_close_log;  // 标记是否关闭日志功能
     int m_actormodel; // 并发模型选择类型
+    int m_io_uring;   // 是否使用io_uring
+    int m_cache_ttl;  // 静态文件缓存有效期(毫秒)
+    int m_read_buf_max; // 单个连接读缓冲区上限(KB)
 
-    int m_pipefd[2];  // socketpair函数第四个参数，套节字柄对，进行双向读写操作
-    int m_epollfd;    // epoll文件描述符
-    http_conn *users; // http_conn类指针 保存所有客户端信息
+    int m_signalfd;       // 接收SIGTERM的signalfd，由主线程的事件循环监听
+    event_loop *m_loops;  // 事件循环数组，m_loops[0]运行在主线程
+    int m_loop_num;       // 事件循环数量
+    std::atomic<bool> m_stop; // 主循环退出后通知其他循环退出
+    conn_table<connection> m_conns; // 按fd保存所有客户端信息，按需分配，连接归属于各事件循环
+    long long m_last_shrink;        // 上一次释放空闲slab的时刻
 
     // 数据库相关
     connection_pool *m_connPool; // 创建的数据库连接池
@@ -64,21 +127,14 @@ public:
     int m_sql_num;               // 数据库连接池数量
 
     // 线程池相关
-    threadpool<http_conn> *m_pool; // 创建的线程池
+    task_pool<http_conn> *m_pool;  // 创建的线程池
     int m_thread_num;              // 线程池内的线程数量
+    int m_task_queue;              // 线程池的任务队列，0为工作窃取队列，1为无锁MPMC队列
 
-    // epoll_event相关
-    epoll_event events[MAX_EVENT_NUMBER]; // epoll事件数组
-
-    int m_listenfd;   // socket文件描述符
     int m_OPT_LINGER; // 是否优雅关闭链接
     int m_TRIGMode;   // Epoll对文件操作符的操作的触发模式
     // 事件触发模式
     int m_LISTENTrigmode; // 监听触发模式
     int m_CONNTrigmode;   // 连接触发模式
-
-    // 定时器相关
-    client_data *users_timer;
-    Utils utils;
 };
 #endif